@@ -1,12 +1,13 @@
 #pragma once
+#include <cassert>
 #include <fstream>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 #include <cmath>
 #include <memory>
+#include <algorithm>
 #include "vector.hpp"
-#include "light.hpp"
 #include "vertex_processor.hpp"
 
 #pragma pack(push, 1)
@@ -50,8 +51,6 @@ struct BMP {
     BMPColorHeader bmp_color_header;
     VertexProcessor& mVertexProcessor;
     std::vector<uint8_t> data;
-    std::vector<std::vector<float>> depth_buffer = {};
-    std::shared_ptr<BMP> mTexture;
 
     BMP(const char *fname, VertexProcessor& vertexProcessor) : mVertexProcessor(vertexProcessor) {
         read(fname);
@@ -123,57 +122,6 @@ struct BMP {
         }
     }
 
-    void fill_triangle_vertex(int x1, int y1, float z1, const float3& vertexColor1, int x2, int y2, float z2, const float3& vertexColor2, int x3, int y3, float z3, const float3& vertexColor3) {
-
-        int channels = bmp_info_header.bit_count / 8;
-
-        const int minx = std::max(std::min(std::min(x1, x2), x3), 0);
-        const int maxx = std::min(std::max(std::max(x1, x2), x3), bmp_info_header.width - 1);
-        const int miny = std::max(std::min(std::min(y1, y2), y3), 0);
-        const int maxy = std::min(std::max(std::max(y1, y2), y3), bmp_info_header.height - 1);
-
-        const int dx12 = x1 - x2;
-        const int dx23 = x2 - x3;
-        const int dx31 = x3 - x1;
-        const int dy12 = y1 - y2;
-        const int dy23 = y2 - y3;
-        const int dy31 = y3 - y1;
-
-        const bool tl1 = dy12 < 0 || (dy12 == 0 && dx12 > 0);
-        const bool tl2 = dy23 < 0 || (dy23 == 0 && dx23 > 0);
-        const bool tl3 = dy31 < 0 || (dy31 == 0 && dx31 > 0);
-
-        for (int y = miny; y <= maxy; ++y) {
-            for (int x = minx; x <= maxx; ++x) {
-
-                const float lambda1 = (float)(dy23*(x - x3)+(x3-x2)*(y-y3))/(float)(dy23*(x1-x3)+(x3-x2)*(y1-y3));
-                const float lambda2 = (float)(dy31*(x-x3)+(x1-x3)*(y-y3))/(float)(dy31*dx23+(x1-x3)*dy23);
-                const float lambda3 = 1 - lambda1 - lambda2;
-
-                const int cond1 = dx12 * (y - y1) - (dy12) * (x - x1);
-                const int cond2 = dx23 * (y - y2) - (dy23) * (x - x2);
-                const int cond3 = dx31 * (y - y3) - (dy31) * (x - x3);
-                const float depth = lambda1 * z1 + lambda2 * z2 + lambda3 * z3;
-
-                if (
-                        (cond1 >= 0 && tl1 || cond1 > 0 && !tl1) &&
-                        (cond2 >= 0 && tl2 || cond2 > 0 && !tl2) &&
-                        (cond3 >= 0 && tl3 || cond3 > 0 && !tl3) &&
-                        depth < depth_buffer[x][y]
-                        )
-                {
-                    depth_buffer[x][y] = depth;
-                    data[channels * (y * bmp_info_header.width + x) + 0] = (int)((lambda1 * vertexColor1.b() + lambda2 * vertexColor2.b() + lambda3 * vertexColor3.b()) * 255);
-                    data[channels * (y * bmp_info_header.width + x) + 1] = (int)((lambda1 * vertexColor1.g() + lambda2 * vertexColor2.g() + lambda3 * vertexColor3.g()) * 255);
-                    data[channels * (y * bmp_info_header.width + x) + 2] = (int)((lambda1 * vertexColor1.r() + lambda2 * vertexColor2.r() + lambda3 * vertexColor3.r()) * 255);
-                    if (channels == 4) {
-                        data[channels * (y * bmp_info_header.width + x) + 3] = 255;
-                    }
-                }
-            }
-        }
-    }
-
     BMP(int32_t width, int32_t height, VertexProcessor& vertexProcessor, bool has_alpha = true) : mVertexProcessor(vertexProcessor) {
         if (width <= 0 || height <= 0) {
             throw std::runtime_error("The image width and height must be positive numbers.");
@@ -205,7 +153,6 @@ struct BMP {
         }
 
         fill_region(0, 0, bmp_info_header.width, bmp_info_header.height, 0, 0, 0, 255);
-        depth_buffer = std::vector<std::vector<float>>(bmp_info_header.width, std::vector<float>(bmp_info_header.height, 1.0f));
 
     }
 
@@ -240,69 +187,9 @@ struct BMP {
         }
     }
 
-    void loadTexture(const char *fname)
+    std::shared_ptr<BMP> createTexture(const char *fname)
     {
-        BMP texture(fname, mVertexProcessor);
-        mTexture = std::make_shared<BMP>(texture);
-    }
-
-    void fill_triangle(int x1, int y1, float z1, const float3& normal1, int x2, int y2, float z2, const float3& normal2, int x3, int y3, float z3, const float3& normal3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3) {
-
-        int channels = bmp_info_header.bit_count / 8;
-
-        const int minx = std::max(std::min(std::min(x1, x2), x3), 0);
-        const int maxx = std::min(std::max(std::max(x1, x2), x3), bmp_info_header.width - 1);
-        const int miny = std::max(std::min(std::min(y1, y2), y3), 0);
-        const int maxy = std::min(std::max(std::max(y1, y2), y3), bmp_info_header.height - 1);
-
-        const int dx12 = x1 - x2;
-        const int dx23 = x2 - x3;
-        const int dx31 = x3 - x1;
-        const int dy12 = y1 - y2;
-        const int dy23 = y2 - y3;
-        const int dy31 = y3 - y1;
-
-        const bool tl1 = dy12 < 0 || (dy12 == 0 && dx12 > 0);
-        const bool tl2 = dy23 < 0 || (dy23 == 0 && dx23 > 0);
-        const bool tl3 = dy31 < 0 || (dy31 == 0 && dx31 > 0);
-
-        for (int y = miny; y <= maxy; ++y) {
-            for (int x = minx; x <= maxx; ++x) {
-
-                const float lambda1 = (float)(dy23*(x - x3)+(x3-x2)*(y-y3))/(float)(dy23*(x1-x3)+(x3-x2)*(y1-y3));
-                const float lambda2 = (float)(dy31*(x-x3)+(x1-x3)*(y-y3))/(float)(dy31*dx23+(x1-x3)*dy23);
-                const float lambda3 = 1 - lambda1 - lambda2;
-
-                const int cond1 = dx12 * (y - y1) - (dy12) * (x - x1);
-                const int cond2 = dx23 * (y - y2) - (dy23) * (x - x2);
-                const int cond3 = dx31 * (y - y3) - (dy31) * (x - x3);
-                const float depth = lambda1 * z1 + lambda2 * z2 + lambda3 * z3;
-
-                if (
-                    (cond1 >= 0 && tl1 || cond1 > 0 && !tl1) &&
-                    (cond2 >= 0 && tl2 || cond2 > 0 && !tl2) &&
-                    (cond3 >= 0 && tl3 || cond3 > 0 && !tl3) &&
-                    depth < depth_buffer[x][y]
-                    )
-                {
-                    depth_buffer[x][y] = depth;
-                    auto normal = normal1 * lambda1 + normal2 * lambda2 + normal3 * lambda3;
-                    normal.normalize();
-                    Fragment fragment;
-                    fragment.normal = normal;
-                    auto position = positions[0] * lambda1 + positions[1] * lambda2 + positions[2] * lambda3;
-                    fragment.position = position;
-                    fragment.textureCoords = f1.textureCoords * lambda1 + f2.textureCoords * lambda2 + f3.textureCoords * lambda3;
-                    const auto vertexColors = light.calculate(fragment, mVertexProcessor, mTexture);
-                    data[channels * (y * bmp_info_header.width + x) + 0] = (int)((vertexColors.b()) * 255);
-                    data[channels * (y * bmp_info_header.width + x) + 1] = (int)((vertexColors.g()) * 255);
-                    data[channels * (y * bmp_info_header.width + x) + 2] = (int)((vertexColors.r()) * 255);
-                    if (channels == 4) {
-                        data[channels * (y * bmp_info_header.width + x) + 3] = 255;
-                    }
-                }
-            }
-        }
+        return std::make_shared<BMP>(fname, mVertexProcessor);
     }
 
     void fill_region(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, uint8_t B, uint8_t G, uint8_t R, uint8_t A) {
@@ -341,13 +228,20 @@ struct BMP {
         if (x0 >= (uint32_t)bmp_info_header.width || y0 >= (uint32_t)bmp_info_header.height || x0 < 0 || y0 < 0) {
             throw std::runtime_error("The point is outside the image boundaries!");
         }
+        set_pixel_unchecked(x0, y0, B, G, R, A);
+    }
+
+    // set_pixel without the bounds check, for callers that clamp their coordinates, debug builds assert
+    void set_pixel_unchecked(uint32_t x0, uint32_t y0, uint8_t B, uint8_t G, uint8_t R, uint8_t A) {
+        assert(x0 < (uint32_t)bmp_info_header.width && y0 < (uint32_t)bmp_info_header.height);
 
         uint32_t channels = bmp_info_header.bit_count / 8;
-        data[channels * (y0 * bmp_info_header.width + x0) + 0] = B;
-        data[channels * (y0 * bmp_info_header.width + x0) + 1] = G;
-        data[channels * (y0 * bmp_info_header.width + x0) + 2] = R;
+        uint8_t* pixel = data.data() + channels * (y0 * bmp_info_header.width + x0);
+        pixel[0] = B;
+        pixel[1] = G;
+        pixel[2] = R;
         if (channels == 4) {
-            data[channels * (y0 * bmp_info_header.width + x0) + 3] = A;
+            pixel[3] = A;
         }
     }
 
@@ -355,6 +249,12 @@ struct BMP {
         if (x0 >= (uint32_t)bmp_info_header.width || y0 >= (uint32_t)bmp_info_header.height || x0 < 0 || y0 < 0) {
             throw std::runtime_error("The point is outside the image boundaries!");
         }
+        return get_pixel_unchecked(x0, y0);
+    }
+
+    // get_pixel without the bounds check, the texture lookup clamps its coordinates, debug builds assert
+    float3 get_pixel_unchecked(uint32_t x0, uint32_t y0) const {
+        assert(x0 < (uint32_t)bmp_info_header.width && y0 < (uint32_t)bmp_info_header.height);
 
         uint32_t channels = bmp_info_header.bit_count / 8;
         uint8_t B = data[channels * (y0 * bmp_info_header.width + x0) + 0];
@@ -8,8 +8,9 @@ Cone::Cone(float r, float h, const Vertex &center, int v) : Mesh(v+2, 2 * v, cen
     float step = (2 * M_PIf32) / v;
     constexpr int firstBaseIndice = 2;
     int k = firstBaseIndice;
-    for (float t = 0 ; t < 2 * M_PIf32 ; t += step )
+    for (int i = 0 ; i < v ; i++ )
     {
+        const float t = i * step;
         Vertex vertex;
         vertex.position = float3{r * cosf(t) + center.position.x(), r*sinf(t) + center.position.y() ,center.position.z()};
         mVertices[k] = vertex;
@@ -31,3 +32,12 @@ Cone::Cone(float r, float h, const Vertex &center, int v) : Mesh(v+2, 2 * v, cen
         k+=2;
     }
 }
+
+LodMesh Cone::createLod(float r, float h, const Vertex &center) {
+    LodMesh lod;
+    lod.addLevel(std::make_shared<Cone>(r, h, center, 8), 0.0f);
+    lod.addLevel(std::make_shared<Cone>(r, h, center, 16), 16.0f);
+    lod.addLevel(std::make_shared<Cone>(r, h, center, 32), 40.0f);
+    lod.addLevel(std::make_shared<Cone>(r, h, center, 64), 100.0f);
+    return lod;
+}
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "mesh.hpp"
+#include "lod_mesh.hpp"
 
 class Cone : public Mesh {
 public:
     Cone(float r, float h, const Vertex &center, int v);
+
+    static LodMesh createLod(float r, float h, const Vertex &center);
 };
 
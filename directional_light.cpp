@@ -1,5 +1,6 @@
 #include "directional_light.hpp"
 #include <algorithm>
+#include <cmath>
 
 float3 DirectionalLight::calculate(const Fragment &fragment, VertexProcessor &vertexProcessor, std::shared_ptr<BMP> texture) const {
     return doCalculate(mPosition, fragment, vertexProcessor, texture);
@@ -10,3 +11,13 @@ DirectionalLight::DirectionalLight(const float3 &position, const float3 &ambient
                                                                                     specular, shininess) {
 
 }
+
+void DirectionalLight::setupShadowProjection(VertexProcessor &lightProcessor, const float3 &center, float radius) const {
+    // orthographic box along the light direction enclosing the bounding sphere of the casters
+    float3 direction = mPosition;
+    direction.normalize();
+    const float3 eye = center + direction * (2.0f * radius);
+    lightProcessor.setOrthographic(radius, radius, radius, 3.0f * radius);
+    const float3 up = std::fabs(direction.y()) > 0.99f ? float3{1.0f, 0.0f, 0.0f} : float3{0.0f, 1.0f, 0.0f};
+    lightProcessor.setLookAt(eye, center, up);
+}
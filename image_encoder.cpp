@@ -0,0 +1,135 @@
+#include "image_encoder.hpp"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include "BMP.h"
+#include "render_stats.hpp"
+
+namespace {
+
+// one output row of 8 bit channels in the given order, plain loops the compiler vectorizes
+void convertRow(const RenderTarget& target, int y, const int (&order)[4], int channels, uint8_t* scratch, uint8_t* out)
+{
+    const int width = target.getWidth();
+    if (target.getFormat() == ColorFormat::RGBA8)
+    {
+        const uint8_t* in = target.getResolvedColorRow(y, scratch);
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                out[x * channels + c] = in[x * 4 + order[c]];
+            }
+        }
+    }
+    else if (target.getFormat() == ColorFormat::RGBA32F)
+    {
+        const float* in = reinterpret_cast<const float*>(target.getResolvedColorRow(y, scratch));
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                out[x * channels + c] = (uint8_t)(std::clamp(in[x * 4 + order[c]], 0.0f, 1.0f) * 255);
+            }
+        }
+    }
+    else
+    {
+        throw std::runtime_error("The render target has no color surface.");
+    }
+}
+
+std::string extension(const std::string& fname)
+{
+    const auto dot = fname.rfind('.');
+    if (dot == std::string::npos)
+    {
+        return "";
+    }
+    std::string ext = fname.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext;
+}
+
+}
+
+std::unique_ptr<ImageEncoder> ImageEncoder::forFile(const std::string &fname) {
+    const auto ext = extension(fname);
+    if (ext == "bmp")
+    {
+        return std::make_unique<BmpEncoder>();
+    }
+    if (ext == "ppm")
+    {
+        return std::make_unique<PpmEncoder>();
+    }
+    if (ext == "raw")
+    {
+        return std::make_unique<RawEncoder>();
+    }
+    throw std::runtime_error("Unsupported image format: " + fname);
+}
+
+void BmpEncoder::encode(const RenderTarget &target, std::ostream &os) const {
+    const int width = target.getWidth();
+    const int height = target.getHeight();
+    const size_t rowSize = width * 4;
+
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    BMPColorHeader colorHeader;
+    infoHeader.size = sizeof(BMPInfoHeader) + sizeof(BMPColorHeader);
+    infoHeader.width = width;
+    infoHeader.height = height;
+    infoHeader.bit_count = 32;
+    infoHeader.compression = 3;
+    fileHeader.offset_data = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + sizeof(BMPColorHeader);
+    fileHeader.file_size = fileHeader.offset_data + rowSize * height;
+    os.write((const char*)&fileHeader, sizeof(fileHeader));
+    os.write((const char*)&infoHeader, sizeof(infoHeader));
+    os.write((const char*)&colorHeader, sizeof(colorHeader));
+
+    std::vector<uint8_t> row(rowSize);
+    std::vector<uint8_t> scratch(target.getColorRowSize());
+    for (int y = height - 1; y >= 0; y--)
+    {
+        convertRow(target, y, {2, 1, 0, 3}, 4, scratch.data(), row.data());
+        os.write((const char*)row.data(), row.size());
+    }
+}
+
+void PpmEncoder::encode(const RenderTarget &target, std::ostream &os) const {
+    os << "P6\n" << target.getWidth() << ' ' << target.getHeight() << "\n255\n";
+    std::vector<uint8_t> row(target.getWidth() * 3);
+    std::vector<uint8_t> scratch(target.getColorRowSize());
+    for (int y = 0; y < target.getHeight(); y++)
+    {
+        convertRow(target, y, {0, 1, 2, 3}, 3, scratch.data(), row.data());
+        os.write((const char*)row.data(), row.size());
+    }
+}
+
+void RawEncoder::encode(const RenderTarget &target, std::ostream &os) const {
+    const size_t pixelSize = target.getFormat() == ColorFormat::RGBA32F ? 4 * sizeof(float) : 4;
+    if (target.getFormat() == ColorFormat::None)
+    {
+        throw std::runtime_error("The render target has no color surface.");
+    }
+    std::vector<uint8_t> scratch(target.getColorRowSize());
+    for (int y = 0; y < target.getHeight(); y++)
+    {
+        os.write((const char*)target.getResolvedColorRow(y, scratch.data()), target.getWidth() * pixelSize);
+    }
+}
+
+void writeImage(const RenderTarget &target, const std::string &fname) {
+    RENDER_STATS_SCOPE(RenderStage::WriteOut, "writeImage");
+    const auto encoder = ImageEncoder::forFile(fname);
+    std::ofstream of{ fname, std::ios_base::binary };
+    if (!of)
+    {
+        throw std::runtime_error("Unable to open the output image file.");
+    }
+    encoder->encode(target, of);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include "render_target.hpp"
+
+/*
+ * converts a render target to a file format, one pass over every row
+ */
+class ImageEncoder {
+public:
+    virtual ~ImageEncoder() = default;
+
+    virtual void encode(const RenderTarget& target, std::ostream& os) const = 0;
+
+    /*
+     * picks the encoder from the file extension: .bmp, .ppm or .raw
+     */
+    static std::unique_ptr<ImageEncoder> forFile(const std::string& fname);
+};
+
+/*
+ * 32 bit BGRA, rows stored bottom up
+ */
+class BmpEncoder : public ImageEncoder {
+public:
+    void encode(const RenderTarget& target, std::ostream& os) const override;
+};
+
+/*
+ * binary P6, 8 bit RGB
+ */
+class PpmEncoder : public ImageEncoder {
+public:
+    void encode(const RenderTarget& target, std::ostream& os) const override;
+};
+
+/*
+ * headerless rows top down, RGBA8 bytes or RGBA32F floats as stored in the target
+ */
+class RawEncoder : public ImageEncoder {
+public:
+    void encode(const RenderTarget& target, std::ostream& os) const override;
+};
+
+void writeImage(const RenderTarget& target, const std::string& fname);
@@ -0,0 +1,62 @@
+#include "job_scheduler.hpp"
+#include <algorithm>
+
+JobScheduler::JobScheduler(size_t threadCount) {
+    threadCount = std::max<size_t>(threadCount, 1);
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        mWorkers.emplace_back(&JobScheduler::workerLoop, this, i);
+    }
+}
+
+JobScheduler::~JobScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mJobAvailable.notify_all();
+    for (auto& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+void JobScheduler::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mJobAvailable.notify_one();
+}
+
+void JobScheduler::wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdle.wait(lock, [this] { return mJobs.empty() && mRunning == 0; });
+}
+
+size_t JobScheduler::getThreadCount() const {
+    return mWorkers.size();
+}
+
+void JobScheduler::workerLoop(size_t worker) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mJobAvailable.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+        if (mJobs.empty())
+        {
+            return;
+        }
+        Job job = std::move(mJobs.front());
+        mJobs.pop_front();
+        mRunning++;
+        lock.unlock();
+        job(worker);
+        lock.lock();
+        mRunning--;
+        if (mJobs.empty() && mRunning == 0)
+        {
+            mIdle.notify_all();
+        }
+    }
+}
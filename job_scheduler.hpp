@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * fixed pool of worker threads running jobs in submission order
+ */
+class JobScheduler {
+public:
+    /*
+     * the job receives the index of the worker running it, for per worker state
+     */
+    using Job = std::function<void(size_t worker)>;
+
+    explicit JobScheduler(size_t threadCount = std::thread::hardware_concurrency());
+
+    /*
+     * finishes the queued jobs before joining the workers
+     */
+    ~JobScheduler();
+
+    JobScheduler(const JobScheduler&) = delete;
+
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    void submit(Job job);
+
+    /*
+     * blocks until every submitted job has finished
+     */
+    void wait();
+
+    size_t getThreadCount() const;
+
+private:
+    void workerLoop(size_t worker);
+
+private:
+    std::vector<std::thread> mWorkers;
+    std::deque<Job> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mIdle;
+    size_t mRunning = 0;
+    bool mStopping = false;
+};
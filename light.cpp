@@ -1,6 +1,59 @@
 #include "light.hpp"
 #include <algorithm>
+#include <cmath>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 #include "BMP.h"
+#include "shadow_map.hpp"
+
+namespace {
+
+// one Newton step refines the hardware estimate to about float precision
+float reciprocalSqrt(float x)
+{
+#if defined(__SSE__)
+    const float estimate = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#else
+    return 1.0f / sqrtf(x);
+#endif
+}
+
+/*
+ * texel index of a texture coordinate, clamped to the edge, written so a NaN coordinate (a vertex
+ * behind the eye, where 1 / w is not positive) lands on 0 instead of passing std::clamp unchanged
+ */
+uint32_t texelIndex(float coordinate, int32_t size)
+{
+    const float texel = coordinate * size;
+    return !(texel > 0.0f) ? 0 : (uint32_t)std::min(texel, (float)(size - 1));
+}
+
+// unit vector in plain floats, vectors of about zero length are left as they are
+struct Direction
+{
+    float x;
+    float y;
+    float z;
+
+    explicit Direction(const float3& v) : x(v.x()), y(v.y()), z(v.z()) {
+        const float squared = x * x + y * y + z * z;
+        if (squared > 1.0e-8f)
+        {
+            const float scale = reciprocalSqrt(squared);
+            x *= scale;
+            y *= scale;
+            z *= scale;
+        }
+    }
+
+    float dot(const Direction& other) const {
+        return x * other.x + y * other.y + z * other.z;
+    }
+};
+
+}
 
 Light::Light(const float3 &position, const float3 &ambient, const float3 &diffuse, const float3 &specular,
              float shininess)
@@ -9,34 +62,99 @@ Light::Light(const float3 &position, const float3 &ambient, const float3 &diffus
 
 }
 
-float3 Light::doCalculate(const float3 &lightDir, const Fragment &fragment, VertexProcessor &vertexProcessor, std::shared_ptr<BMP> texture) const {
-    auto N = fragment.normal;
-    N.normalize();
-    auto V = fragment.position;
-    V.normalize();
-    V.negate();
+void Light::setShadowMap(std::shared_ptr<ShadowMap> shadowMap) {
+    mShadowMap = std::move(shadowMap);
+}
 
-    Vector L = lightDir;
-    L.normalize();
+const std::shared_ptr<ShadowMap> &Light::getShadowMap() const {
+    return mShadowMap;
+}
 
-    float shade = std::clamp(N.dotProduct(L), 0.0f, 1.0f);
-    const float3 diffuse{shade * mDiffuse.r(), shade * mDiffuse.g(), shade * mDiffuse.b()};
+const float3 &Light::getPosition() const {
+    return mPosition;
+}
 
+void Light::setQuality(LightingQuality quality) {
+    mQuality = quality;
+    mSpecularTable.clear();
+    if (quality == LightingQuality::Fast)
+    {
+        // linear interpolation is off by at most h^2 / 8 * s (s - 1) for spacing h and shininess s,
+        // 16 entries per unit of shininess keep that below 1 / 2048
+        const size_t size = std::max<size_t>(256, 16 * (size_t)std::ceil(mShininess));
+        mSpecularTable.resize(size + 1);
+        for (size_t i = 0; i <= size; i++)
+        {
+            mSpecularTable[i] = powf((float)i / size, mShininess);
+        }
+    }
+}
+
+LightingQuality Light::getQuality() const {
+    return mQuality;
+}
+
+float Light::specularPower(float x) const {
+    const float position = x * (mSpecularTable.size() - 1);
+    const size_t index = std::min((size_t)position, mSpecularTable.size() - 2);
+    const float t = position - index;
+    return mSpecularTable[index] + (mSpecularTable[index + 1] - mSpecularTable[index]) * t;
+}
+
+float3 Light::doCalculate(const float3 &lightDir, const Fragment &fragment, VertexProcessor &vertexProcessor, std::shared_ptr<BMP> texture) const {
+    float shade = 0.0f;
     float shine = 0.0f;
-    if (L.dotProduct(N) >= 0.0f)
+    if (mQuality == LightingQuality::Fast)
     {
-        auto R = (N * N.dotProduct(L) * 2.0f) - L;
-        R.normalize();
-        shine = std::clamp(R.dotProduct(V), 0.0f, 1.0f);
-        shine = powf(shine, mShininess);
+        // plain floats normalized by reciprocalSqrt instead of Vector::normalizeUnchecked, which divides by a sqrt
+        const Direction N(fragment.normal);
+        const Direction P(fragment.position);
+        const Direction L(lightDir);
+        const float NdotL = N.dot(L);
+        shade = std::clamp(NdotL, 0.0f, 1.0f);
+        if (NdotL >= 0.0f)
+        {
+            // reflecting a unit vector about a unit normal keeps it unit length, V is -P
+            const float NdotP = N.dot(P);
+            const float RdotV = L.dot(P) - 2.0f * NdotL * NdotP;
+            shine = specularPower(std::clamp(RdotV, 0.0f, 1.0f));
+        }
     }
+    else
+    {
+        auto N = fragment.normal;
+        N.normalizeUnchecked();
+        auto V = fragment.position;
+        V.normalizeUnchecked();
+        V.negate();
+
+        Vector L = lightDir;
+        L.normalizeUnchecked();
+
+        shade = std::clamp(N.dotProduct(L), 0.0f, 1.0f);
+
+        if (L.dotProduct(N) >= 0.0f)
+        {
+            auto R = (N * N.dotProduct(L) * 2.0f) - L;
+            R.normalizeUnchecked();
+            shine = std::clamp(R.dotProduct(V), 0.0f, 1.0f);
+            shine = powf(shine, mShininess);
+        }
+    }
+    if (mShadowMap)
+    {
+        const float visibility = mShadowMap->visibility(fragment.position);
+        shade *= visibility;
+        shine *= visibility;
+    }
+    const float3 diffuse{shade * mDiffuse.r(), shade * mDiffuse.g(), shade * mDiffuse.b()};
     const float3 specular{shine * mSpecular.r(), shine * mSpecular.g(), shine * mSpecular.b()};
 
     auto sum = mAmbient + specular + diffuse;
 
     if (texture)
     {
-        const auto t = texture->get_pixel(std::clamp(fragment.textureCoords.x() * texture->bmp_info_header.width, 0.0f, (float)texture->bmp_info_header.width-1), std::clamp(fragment.textureCoords.y() * texture->bmp_info_header.height, 0.0f, (float)texture->bmp_info_header.height-1));
+        const auto t = texture->get_pixel_unchecked(texelIndex(fragment.textureCoords.x(), texture->bmp_info_header.width), texelIndex(fragment.textureCoords.y(), texture->bmp_info_header.height));
         sum += t;
     }
 
@@ -1,11 +1,18 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "vector.hpp"
 #include "vertex_processor.hpp"
 #include "vertex.hpp"
 
 class BMP;
+class ShadowMap;
+
+enum class LightingQuality {
+    Exact,                                   // powf and full normalization
+    Fast                                     // specular table for the shininess and reciprocal square root normalization
+};
 
 class Light {
 public:
@@ -14,14 +21,41 @@ public:
 public:
     virtual float3 calculate(const Fragment &fragment, VertexProcessor& vertexProcessor, std::shared_ptr<BMP> texture = nullptr) const = 0;
 
+    /*
+     * view and projection used to render the shadow map of casters enclosed by the sphere
+     */
+    virtual void setupShadowProjection(VertexProcessor& lightProcessor, const float3& center, float radius) const = 0;
+
+    void setShadowMap(std::shared_ptr<ShadowMap> shadowMap);
+
+    const std::shared_ptr<ShadowMap>& getShadowMap() const;
+
+    const float3& getPosition() const;
+
+    /*
+     * Fast stays within fastMaxError of Exact on every channel, the specular table is built here,
+     * so call it before drawing and not while other threads shade with the light
+     */
+    void setQuality(LightingQuality quality);
+
+    LightingQuality getQuality() const;
+
+    static constexpr float fastMaxError = 1.0f / 255.0f;
+
 protected:
     virtual float3 doCalculate(const float3& lightDir, const Fragment &fragment, VertexProcessor& vertexProcessor, std::shared_ptr<BMP> texture = nullptr) const;
 
+    // powf(x, mShininess) for x in [0, 1] from the table
+    float specularPower(float x) const;
+
 protected:
     float3 mPosition;
     float3 mAmbient;
     float3 mDiffuse;
     float3 mSpecular;
     float mShininess;
+    std::shared_ptr<ShadowMap> mShadowMap;
+    LightingQuality mQuality = LightingQuality::Exact;
+    std::vector<float> mSpecularTable;       // Fast only, evenly spaced samples of powf including x = 1
 };
 
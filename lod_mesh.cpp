@@ -0,0 +1,64 @@
+#include "lod_mesh.hpp"
+#include <stdexcept>
+
+void LodMesh::addLevel(std::shared_ptr<Mesh> mesh, float minPixelRadius) {
+    if (!mLevels.empty() && minPixelRadius < mLevels.back().minPixelRadius)
+    {
+        throw std::runtime_error("LOD levels must be added from the coarsest to the finest");
+    }
+    mesh->prepare();
+    mLevels.push_back({std::move(mesh), minPixelRadius});
+}
+
+Mesh &LodMesh::selectLevel(const Rasterizer &rasterizer, const VertexProcessor &vertexProcessor) {
+    if (mLevels.empty())
+    {
+        throw std::runtime_error("LOD mesh has no levels");
+    }
+    // finest level bounds are the tightest for every level
+    const Mesh& finest = *mLevels.back().mesh;
+    const float pixelRadius = vertexProcessor.projectedRadius(finest.getBoundingCenter(), finest.getBoundingRadius()) * rasterizer.getHeight() * 0.5f;
+    size_t selected = 0;
+    for (size_t i = 0; i < mLevels.size(); i++)
+    {
+        if (pixelRadius >= mLevels[i].minPixelRadius)
+        {
+            selected = i;
+        }
+    }
+    return *mLevels[selected].mesh;
+}
+
+void LodMesh::draw(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, Light &light) {
+    selectLevel(rasterizer, vertexProcessor).draw(rasterizer, vertexProcessor, light);
+}
+
+void LodMesh::drawInstanced(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, const std::vector<MeshInstance> &instances) {
+    const float4x4 previousObj2World = vertexProcessor.getObj2World();
+    std::vector<std::vector<MeshInstance>> perLevel(mLevels.size());
+    for (const auto& instance : instances)
+    {
+        vertexProcessor.setObj2World(instance.transform);
+        const Mesh* level = &selectLevel(rasterizer, vertexProcessor);
+        for (size_t i = 0; i < mLevels.size(); i++)
+        {
+            if (mLevels[i].mesh.get() == level)
+            {
+                perLevel[i].push_back(instance);
+                break;
+            }
+        }
+    }
+    vertexProcessor.setObj2World(previousObj2World);
+    for (size_t i = 0; i < mLevels.size(); i++)
+    {
+        if (!perLevel[i].empty())
+        {
+            mLevels[i].mesh->drawInstanced(rasterizer, vertexProcessor, perLevel[i]);
+        }
+    }
+}
+
+size_t LodMesh::getLevelCount() const {
+    return mLevels.size();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "mesh.hpp"
+
+/*
+ * chain of tessellation levels of the same shape, the level is picked from projected screen space radius
+ */
+class LodMesh {
+public:
+    /*
+     * levels have to be added from the coarsest to the finest
+     */
+    void addLevel(std::shared_ptr<Mesh> mesh, float minPixelRadius);
+
+    Mesh& selectLevel(const Rasterizer& rasterizer, const VertexProcessor& vertexProcessor);
+
+    void draw(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, Light& light);
+
+    void drawInstanced(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, const std::vector<MeshInstance>& instances);
+
+    size_t getLevelCount() const;
+
+private:
+    struct Level
+    {
+        std::shared_ptr<Mesh> mesh;
+        float minPixelRadius;
+    };
+
+    std::vector<Level> mLevels;
+};
@@ -1,6 +1,9 @@
+#include <fstream>
 #include <iostream>
 #include "BMP.h"
+#include "image_encoder.hpp"
 #include "rasterizer.hpp"
+#include "render_target.hpp"
 #include "vector.hpp"
 #include "vertex_processor.hpp"
 #include "mesh.hpp"
@@ -9,12 +12,15 @@
 #include "sphere.hpp"
 #include "directional_light.hpp"
 #include "point_light.hpp"
+#include "render_queue.hpp"
+#include "render_stats.hpp"
+#include "shadow_map.hpp"
 
 int main() {
     VertexProcessor vertexProcessor;
     vertexProcessor.setPerspective(120, 1, 0.5, 100);
-	BMP bmp2(400, 400, vertexProcessor);
-    Rasterizer rasterizer(bmp2);
+    RenderTarget target(400, 400);
+    Rasterizer rasterizer(target, vertexProcessor);
     Vertex vertexCenter;
     vertexCenter.position.z() = -2.0f;
     const float3 eye{8.0f, 0.0f, -5.0f};
@@ -29,26 +35,48 @@ int main() {
 //    DirectionalLight light(position, ambient, diffuse, specular, shininess);
     PointLight noLight(position, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f);
     PointLight light(position, ambient, diffuse, specular, shininess);
+    light.setShadowMap(std::make_shared<ShadowMap>(512));
 
-    bmp2.loadTexture("moon.bmp");
-    Vertex sphereCenter;
-    sphereCenter.position.z() = -1.5f;
-    Sphere sphere(10, 10, sphereCenter, .5f);
-    sphere.draw(rasterizer, vertexProcessor, light);
-
-    Vertex sphereCenter2;
-    sphereCenter2.position = float3{-1.0f, 0.0f, -1.0f};
-    Sphere sphere2(10, 10, sphereCenter2, .5f);
-
-    bmp2.loadTexture("earth.bmp");
+    const auto moon = std::make_shared<BMP>("moon.bmp", vertexProcessor);
+    const auto earth = std::make_shared<BMP>("earth.bmp", vertexProcessor);
 
-    sphere2.draw(rasterizer, vertexProcessor, light);
-
-    Vertex sphereCenter3;
-    sphereCenter3.position = float3{1.0f, 0.0f, -1.0f};
-    Sphere sphere3(10, 10, sphereCenter3, .5f);
+    // one shared sphere, drawn at three places with tessellation picked from screen size
+    Vertex sphereCenter;
+    LodMesh sphere = Sphere::createLod(sphereCenter, .5f);
 
-    sphere3.draw(rasterizer, vertexProcessor, noLight);
-	bmp2.write("img_test.bmp");
+    std::vector<MeshInstance> instances(3);
+    instances[0].transform = VertexProcessor::translation(float3{0.0f, 0.0f, -1.5f});
+    instances[0].texture = moon;
+    instances[0].light = &light;
+    instances[1].transform = VertexProcessor::translation(float3{-1.0f, 0.0f, -1.0f});
+    instances[1].texture = earth;
+    instances[1].light = &light;
+    instances[2].transform = VertexProcessor::translation(float3{1.0f, 0.0f, -1.0f});
+    instances[2].texture = earth;
+    instances[2].light = &noLight;
+    // same frame without and with a depth prepass, the image is identical, only the shading work differs
+    RenderQueue queue;
+    std::ofstream statsFile{ "render_stats.json" };
+    size_t frame = 0;
+    Profiler::setTraceRecording(true);
+    for (const bool depthPrepass : {false, true})
+    {
+        Profiler::beginFrame();
+        target.clearColor({0.0f, 0.0f, 0.0f});
+        target.clearDepth();
+        for (const auto& instance : instances)
+        {
+            queue.submit(sphere, instance);
+        }
+        queue.setDepthPrepass(depthPrepass);
+        queue.flush(rasterizer, vertexProcessor);
+        std::cout << (depthPrepass ? "depth prepass" : "single pass") << ": " << queue.getStats().shadedFragments << " shaded fragments" << std::endl;
+        if (depthPrepass)
+        {
+            writeImage(target, "img_test.bmp");
+        }
+        Profiler::endFrame(target.getCoveredPixels()).writeJson(statsFile, frame++);
+    }
+    Profiler::writeChromeTrace("render_trace.json");
     return 0;
 }
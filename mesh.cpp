@@ -1,10 +1,29 @@
 #include "mesh.hpp"
 #include <utility>
 #include <algorithm>
+#include <functional>
 #include "vertex.hpp"
+#include "mesh_optimizer.hpp"
+#include "render_stats.hpp"
+
+namespace {
+
+// post transform vertices of the draw in progress, per thread so shared meshes can be drawn concurrently
+struct TransformCache
+{
+    std::vector<float3> positions;
+    std::vector<float3> normals;
+    std::vector<float> inverseW;
+    std::vector<unsigned> stamps;
+    unsigned stamp = 0;
+};
+
+thread_local TransformCache transformCache;
+
+}
 
 void Mesh::drawVertex(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, Light& light) {
-    calculateNormals();
+    prepare();
     for (const auto& triangle : mIndices)
     {
         std::vector<float3> positions;
@@ -12,9 +31,10 @@ void Mesh::drawVertex(Rasterizer &rasterizer, VertexProcessor &vertexProcessor,
         positions.reserve(triangle.size());
         for (int i = 0; i < triangle.size(); i++)
         {
-            positions.push_back(vertexProcessor.convertToCanonical(mVertices[triangle[i]].position));
+            const auto vertex = getVertex(triangle[i]);
+            positions.push_back(vertexProcessor.convertToCanonical(vertex.position));
             // TODO: these normals should also be converted but only to View (not projection)
-            normals.push_back(mVertices[triangle[i]].normal);
+            normals.push_back(vertex.normal);
         }
         Vertex fragment1;
         fragment1.position = positions[0];
@@ -33,7 +53,9 @@ void Mesh::drawVertex(Rasterizer &rasterizer, VertexProcessor &vertexProcessor,
 }
 
 void Mesh::draw(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, Light& light) {
-    calculateNormals();
+    RENDER_STATS_SCOPE("Mesh::draw");
+    prepare();
+    RENDER_STATS_COUNT(trianglesSubmitted, mIndices.size());
     for (const auto& triangle : mIndices)
     {
         std::vector<float3> positions;
@@ -41,8 +63,10 @@ void Mesh::draw(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, Light&
         positions.reserve(triangle.size());
         for (int i = 0; i < triangle.size(); i++)
         {
-            positions.push_back(vertexProcessor.convertToCanonical(mVertices[triangle[i]].position));
-            normals.push_back(mVertices[triangle[i]].normal);
+            RENDER_STATS_SCOPE(RenderStage::Transform);
+            const auto vertex = getVertex(triangle[i]);
+            positions.push_back(vertexProcessor.convertToCanonical(vertex.position));
+            normals.push_back(vertex.normal);
         }
         Vertex fragment1;
         fragment1.position = positions[0];
@@ -97,16 +121,447 @@ void Mesh::draw(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, Light&
     }
 }
 
+void Mesh::drawInstanced(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, const std::vector<MeshInstance> &instances) {
+    prepare();
+    std::vector<const MeshInstance*> bins;
+    bins.reserve(instances.size());
+    for (const auto& instance : instances)
+    {
+        bins.push_back(&instance);
+    }
+    std::stable_sort(bins.begin(), bins.end(), [](const MeshInstance* a, const MeshInstance* b) {
+        if (a->texture != b->texture)
+        {
+            return std::less<BMP*>()(a->texture.get(), b->texture.get());
+        }
+        return std::less<const Light*>()(a->light, b->light);
+    });
+
+    const float4x4 previousObj2World = vertexProcessor.getObj2World();
+    const BMP* boundTexture = nullptr;
+    bool anyBound = false;
+    for (const auto* instance : bins)
+    {
+        if (!anyBound || instance->texture.get() != boundTexture)
+        {
+            rasterizer.bindTexture(instance->texture);
+            boundTexture = instance->texture.get();
+            anyBound = true;
+        }
+        drawInstance(rasterizer, vertexProcessor, *instance);
+    }
+    vertexProcessor.setObj2World(previousObj2World);
+}
+
+void Mesh::drawInstance(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, const MeshInstance &instance) {
+    if (instance.light != nullptr)
+    {
+        drawInstance(rasterizer, vertexProcessor, instance, false);
+    }
+}
+
+void Mesh::drawInstanceDepth(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, const MeshInstance &instance) {
+    drawInstance(rasterizer, vertexProcessor, instance, true);
+}
+
+void Mesh::drawInstance(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, const MeshInstance &instance, bool depthOnly) {
+    RENDER_STATS_SCOPE(depthOnly ? "Mesh::drawDepth" : "Mesh::draw");
+    prepare();
+    RENDER_STATS_COUNT(trianglesSubmitted, mIndices.size());
+    vertexProcessor.setObj2World(instance.transform);
+    if (!vertexProcessor.isSphereVisible(mBoundingCenter, mBoundingRadius))
+    {
+        RENDER_STATS_COUNT(trianglesCulled, mIndices.size());
+        return;
+    }
+
+    auto& cache = transformCache;
+    if (++cache.stamp == 0)
+    {
+        cache.stamp = 1;
+        std::fill(cache.stamps.begin(), cache.stamps.end(), 0);
+    }
+    const size_t vertexCount = getVertexCount();
+    if (cache.stamps.size() < vertexCount)
+    {
+        cache.positions.resize(vertexCount);
+        cache.normals.resize(vertexCount);
+        cache.inverseW.resize(vertexCount);
+        cache.stamps.resize(vertexCount, 0);
+    }
+
+    if (mMeshlets.empty())
+    {
+        drawTriangles(rasterizer, vertexProcessor, instance, 0, mIndices.size(), depthOnly);
+        return;
+    }
+    for (const auto& meshlet : mMeshlets)
+    {
+        if (!isMeshletVisible(meshlet, &rasterizer, vertexProcessor))
+        {
+            RENDER_STATS_COUNT(trianglesCulled, meshlet.triangleCount);
+            continue;
+        }
+        drawTriangles(rasterizer, vertexProcessor, instance, meshlet.firstTriangle, meshlet.firstTriangle + meshlet.triangleCount, depthOnly);
+    }
+}
+
+bool Mesh::isMeshletVisible(const Meshlet &meshlet, const Rasterizer *rasterizer, const VertexProcessor &vertexProcessor) const {
+    if (!vertexProcessor.isSphereVisible(meshlet.center, meshlet.radius) || isMeshletBackFacing(meshlet, vertexProcessor))
+    {
+        return false;
+    }
+    ScreenBounds bounds;
+    return !(rasterizer && mOcclusionCulling && vertexProcessor.projectSphere(meshlet.center, meshlet.radius, bounds) && rasterizer->isOccluded(bounds));
+}
+
+void Mesh::drawTriangles(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, const MeshInstance &instance, size_t first, size_t last, bool depthOnly) {
+    auto& cache = transformCache;
+    {
+        RENDER_STATS_SCOPE(RenderStage::Transform);
+        for (size_t t = first; t < last; t++)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                // shared vertices are transformed once per instance instead of once per triangle
+                const int index = mIndices[t][i];
+                if (cache.stamps[index] != cache.stamp)
+                {
+                    transformVertex(vertexProcessor, instance.transform, index, cache.positions[index], cache.inverseW[index], depthOnly ? nullptr : &cache.normals[index]);
+                    cache.stamps[index] = cache.stamp;
+                }
+            }
+        }
+    }
+    rasterizeTriangles(rasterizer, instance, cache.positions.data(), cache.inverseW.data(), cache.normals.data(), first, last, depthOnly);
+}
+
+bool Mesh::transformInstance(VertexProcessor &vertexProcessor, const MeshInstance &instance, TransformedInstance &transformed) {
+    if (!cullInstance(vertexProcessor, instance, transformed))
+    {
+        return false;
+    }
+    transformVertices(vertexProcessor, transformed, 0, transformed.used.size());
+    return true;
+}
+
+bool Mesh::cullInstance(VertexProcessor &vertexProcessor, const MeshInstance &instance, TransformedInstance &transformed) {
+    RENDER_STATS_SCOPE("Mesh::cull");
+    prepare();
+    RENDER_STATS_COUNT(trianglesSubmitted, mIndices.size());
+    vertexProcessor.setObj2World(instance.transform);
+    transformed.mesh = this;
+    transformed.instance = instance;
+    transformed.ranges.clear();
+    transformed.setUp = false;
+    if (!vertexProcessor.isSphereVisible(mBoundingCenter, mBoundingRadius))
+    {
+        RENDER_STATS_COUNT(trianglesCulled, mIndices.size());
+        return false;
+    }
+    if (mMeshlets.empty())
+    {
+        transformed.ranges.emplace_back(0, mIndices.size());
+    }
+    for (const auto& meshlet : mMeshlets)
+    {
+        if (!isMeshletVisible(meshlet, nullptr, vertexProcessor))
+        {
+            RENDER_STATS_COUNT(trianglesCulled, meshlet.triangleCount);
+            continue;
+        }
+        transformed.ranges.emplace_back(meshlet.firstTriangle, meshlet.firstTriangle + meshlet.triangleCount);
+    }
+
+    const size_t vertexCount = getVertexCount();
+    transformed.positions.resize(vertexCount);
+    transformed.normals.resize(vertexCount);
+    transformed.inverseW.resize(vertexCount);
+    transformed.used.assign(vertexCount, 0);
+    for (const auto& range : transformed.ranges)
+    {
+        for (size_t t = range.first; t < range.second; t++)
+        {
+            transformed.used[mIndices[t][0]] = 1;
+            transformed.used[mIndices[t][1]] = 1;
+            transformed.used[mIndices[t][2]] = 1;
+        }
+    }
+    return !transformed.ranges.empty();
+}
+
+void Mesh::transformVertices(const VertexProcessor &vertexProcessor, TransformedInstance &transformed, size_t first, size_t last) const {
+    RENDER_STATS_SCOPE(RenderStage::Transform, "Mesh::transform");
+    for (size_t index = first; index < last; index++)
+    {
+        if (transformed.used[index])
+        {
+            transformVertex(vertexProcessor, transformed.instance.transform, index, transformed.positions[index], transformed.inverseW[index], &transformed.normals[index]);
+        }
+    }
+}
+
+void Mesh::setupTriangles(const Rasterizer &rasterizer, const TransformedInstance &transformed, size_t first, size_t last, std::vector<Rasterizer::PreparedTriangle> &triangles) const {
+    RENDER_STATS_SCOPE(RenderStage::Setup, "Mesh::setup");
+    triangles.clear();
+    Vertex fragments[3];
+    const bool packed = isPacked();
+    Rasterizer::PreparedTriangle prepared;
+    for (size_t t = first; t < last; t++)
+    {
+        const auto& triangle = mIndices[t];
+        for (int i = 0; i < 3; i++)
+        {
+            fragments[i].normal = transformed.normals[triangle[i]];
+            fragments[i].textureCoords = packed ? mPackedVertices.getTextureCoords(triangle[i]) : mVertices[triangle[i]].textureCoords;
+        }
+        const float3 inverseW{transformed.inverseW[triangle[0]], transformed.inverseW[triangle[1]], transformed.inverseW[triangle[2]]};
+        if (rasterizer.prepareTriangle(transformed.positions[triangle[0]], transformed.positions[triangle[1]], transformed.positions[triangle[2]], fragments[0], fragments[1], fragments[2], inverseW, prepared))
+        {
+            triangles.push_back(prepared);
+        }
+    }
+}
+
+void Mesh::drawTransformed(Rasterizer &rasterizer, const TransformedInstance &transformed, bool depthOnly) const {
+    RENDER_STATS_SCOPE(depthOnly ? "Mesh::drawDepth" : "Mesh::draw");
+    if (transformed.setUp)
+    {
+        for (const auto& span : transformed.triangles)
+        {
+            for (const auto& triangle : span)
+            {
+                if (depthOnly)
+                {
+                    rasterizer.drawPreparedDepth(triangle);
+                }
+                else
+                {
+                    rasterizer.drawPrepared(triangle, *transformed.instance.light);
+                }
+            }
+        }
+        return;
+    }
+    for (const auto& range : transformed.ranges)
+    {
+        rasterizeTriangles(rasterizer, transformed.instance, transformed.positions.data(), transformed.inverseW.data(), transformed.normals.data(), range.first, range.second, depthOnly);
+    }
+}
+
+void Mesh::transformVertex(const VertexProcessor &vertexProcessor, const float4x4 &transform, int index, float3 &position, float &inverseW, float3 *normal) const {
+    // packed attributes are decoded here, the rest of the pipeline only sees floats
+    const bool packed = isPacked();
+    position = vertexProcessor.convertToCanonical(packed ? mPackedVertices.getPosition(index) : mVertices[index].position, inverseW);
+    if (normal)
+    {
+        const auto n = packed ? mPackedVertices.getNormalDirection(index) : mVertices[index].normal;
+        float4 transformedNormal{n.x(), n.y(), n.z(), 0.0f};
+        transformedNormal *= transform;
+        *normal = float3{transformedNormal.x(), transformedNormal.y(), transformedNormal.z()};
+        normal->normalizeUnchecked();
+    }
+}
+
+void Mesh::rasterizeTriangles(Rasterizer &rasterizer, const MeshInstance &instance, const float3 *positions, const float *inverseW, const float3 *normals, size_t first, size_t last, bool depthOnly) const {
+    std::vector<float3> trianglePositions(3);
+    Vertex fragments[3];
+    const bool packed = isPacked();
+    for (size_t t = first; t < last; t++)
+    {
+        const auto& triangle = mIndices[t];
+        for (int i = 0; i < 3; i++)
+        {
+            trianglePositions[i] = positions[triangle[i]];
+        }
+        const auto& p = trianglePositions;
+        if (depthOnly)
+        {
+            rasterizer.drawTriangleDepth(p[0].x(), p[0].y(), p[0].z(), p[1].x(), p[1].y(), p[1].z(), p[2].x(), p[2].y(), p[2].z());
+            continue;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            fragments[i].position = p[i];
+            fragments[i].normal = normals[triangle[i]];
+            fragments[i].textureCoords = packed ? mPackedVertices.getTextureCoords(triangle[i]) : mVertices[triangle[i]].textureCoords;
+        }
+        rasterizer.drawTriangle(p[0].x(), p[0].y(), p[0].z(), fragments[0].normal, p[1].x(), p[1].y(), p[1].z(), fragments[1].normal, p[2].x(), p[2].y(), p[2].z(), fragments[2].normal, *instance.light, trianglePositions, fragments[0], fragments[1], fragments[2],
+                                float3{inverseW[triangle[0]], inverseW[triangle[1]], inverseW[triangle[2]]});
+    }
+}
+
 Mesh::Mesh(int vSize, int tSize, Vertex center) : mVertices(vSize), mIndices(tSize), mCenter(std::move(center)) {
 }
 
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<int3> indices, bool hasNormals, bool hasTextureCoords)
+        : mVertices(std::move(vertices)), mIndices(std::move(indices)), mHasNormals(hasNormals), mHasTextureCoords(hasTextureCoords) {
+    calculateBounds();
+    mCenter.position = mBoundingCenter;
+}
+
+void Mesh::prepare() {
+    if (mPrepared)
+    {
+        return;
+    }
+    if (!mHasNormals)
+    {
+        calculateNormals();
+    }
+    if (!mHasTextureCoords)
+    {
+        calculateTextureCoords();
+    }
+    calculateBounds();
+    if (mMeshlets.empty() && mIndices.size() >= minTrianglesForMeshlets)
+    {
+        buildMeshlets();
+    }
+    if (mVertexFormat != VertexFormat::Full)
+    {
+        mPackedVertices = PackedVertexBuffer(mVertices, mVertexFormat == VertexFormat::PackedHalfPosition);
+        std::vector<Vertex>().swap(mVertices);
+    }
+    mPrepared = true;
+}
+
+void Mesh::buildMeshlets(size_t maxTriangles) {
+    if (isPacked())
+    {
+        throw std::runtime_error("meshlets of a packed mesh have to be built before prepare");
+    }
+    mMeshlets = ::buildMeshlets(mVertices, mIndices, maxTriangles);
+}
+
+void Mesh::setOcclusionCulling(bool enabled) {
+    mOcclusionCulling = enabled;
+}
+
+size_t Mesh::getMeshletCount() const {
+    return mMeshlets.size();
+}
+
+void Mesh::optimize(int cacheSize) {
+    if (isPacked())
+    {
+        throw std::runtime_error("a packed mesh has to be optimized before prepare");
+    }
+    std::vector<size_t> clusterStarts;
+    const auto cacheOrder = optimizeVertexCache(mIndices, mVertices.size(), cacheSize, &clusterStarts);
+    mIndices = optimizeOverdraw(cacheOrder, mVertices, clusterStarts, cacheSize);
+    mVertices = optimizeVertexFetch(mVertices, mIndices);
+    if (!mMeshlets.empty())
+    {
+        buildMeshlets();
+    }
+    if (mPrepared)
+    {
+        calculateBounds();
+    }
+}
+
+void Mesh::setVertexFormat(VertexFormat format) {
+    if (mPrepared && format != mVertexFormat)
+    {
+        throw std::runtime_error("vertex format of a prepared mesh cannot change");
+    }
+    mVertexFormat = format;
+}
+
+VertexFormat Mesh::getVertexFormat() const {
+    return mVertexFormat;
+}
+
+size_t Mesh::getVertexCount() const {
+    return isPacked() ? mPackedVertices.size() : mVertices.size();
+}
+
+Vertex Mesh::getVertex(size_t index) const {
+    return isPacked() ? mPackedVertices.getVertex(index) : mVertices[index];
+}
+
+size_t Mesh::getVertexMemory() const {
+    return isPacked() ? mPackedVertices.sizeInBytes() : mVertices.size() * sizeof(Vertex);
+}
+
+bool Mesh::isPacked() const {
+    return mPrepared && mVertexFormat != VertexFormat::Full;
+}
+
+const float3 &Mesh::getBoundingCenter() const {
+    return mBoundingCenter;
+}
+
+float Mesh::getBoundingRadius() const {
+    return mBoundingRadius;
+}
+
+const std::vector<Vertex> &Mesh::getVertices() const {
+    return mVertices;
+}
+
+const std::vector<int3> &Mesh::getIndices() const {
+    return mIndices;
+}
+
+void Mesh::calculateTextureCoords() {
+    // spherical mapping around the mesh center in object space
+    constexpr float epsilon = 1.0e-4;
+    for (auto & mVertice : mVertices)
+    {
+        auto dir = mVertice.position - mCenter.position;
+        const float len = dir.length();
+        if (len <= epsilon)
+        {
+            mVertice.textureCoords = float3{0.5f, 0.5f, 0.0f};
+            continue;
+        }
+        dir /= len;
+        const float u = std::clamp(atan2f(dir.x(), dir.z()) / (2 * M_PIf32) + 0.5f, 0.0f, 1.0f);
+        const float v = std::clamp(asinf(std::clamp(dir.y(), -1.0f, 1.0f)) / M_PIf32 + 0.5f, 0.0f, 1.0f);
+        mVertice.textureCoords = float3{u, v, 0.0f};
+    }
+}
+
+void Mesh::calculateBounds() {
+    mBoundingCenter = float3{0.0f, 0.0f, 0.0f};
+    if (mVertices.empty())
+    {
+        mBoundingRadius = 0.0f;
+        return;
+    }
+    float3 minCorner = mVertices[0].position;
+    float3 maxCorner = mVertices[0].position;
+    for (const auto & mVertice : mVertices)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            minCorner[i] = std::min(minCorner[i], mVertice.position[i]);
+            maxCorner[i] = std::max(maxCorner[i], mVertice.position[i]);
+        }
+    }
+    mBoundingCenter = (minCorner + maxCorner) * 0.5f;
+    mBoundingRadius = 0.0f;
+    for (const auto & mVertice : mVertices)
+    {
+        mBoundingRadius = std::max(mBoundingRadius, (mVertice.position - mBoundingCenter).length());
+    }
+}
+
 void Mesh::calculateNormals() {
     for (auto & mVertice : mVertices)
         mVertice.normal = float3{0.0f, 0.0f, 0.0f};
+    constexpr float epsilon = 1.0e-8;
     for (const auto & mIndice : mIndices)
     {
         float3 n = crossProduct((mVertices[mIndice.z()].position -
                                mVertices[mIndice.x()].position), mVertices[mIndice.y()].position - mVertices[ mIndice.x()].position);
+        // degenerate triangles of loaded assets do not contribute
+        if (n.dotProduct(n) <= epsilon)
+        {
+            continue;
+        }
         n.normalize();
         mVertices [ mIndice.x() ].normal += n ;
         mVertices [ mIndice.y() ].normal += n ;
@@ -114,6 +569,11 @@ void Mesh::calculateNormals() {
     }
     for (auto & mVertice : mVertices)
     {
+        if (mVertice.normal.dotProduct(mVertice.normal) <= epsilon)
+        {
+            mVertice.normal = float3{0.0f, 0.0f, 1.0f};
+            continue;
+        }
         mVertice.normal.normalize();
     }
 }
@@ -1,26 +1,184 @@
 #pragma once
 
+#include <memory>
 #include "vector.hpp"
 #include "rasterizer.hpp"
 #include "vertex_processor.hpp"
 #include "vertex.hpp"
+#include "packed_vertex.hpp"
 #include "light.hpp"
+#include "meshlet.hpp"
+
+struct MeshInstance
+{
+    float4x4 transform{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+    std::shared_ptr<BMP> texture;
+    const Light* light = nullptr;
+    bool occluder = false;                   // drawn into the occlusion buffer of RenderQueue first
+};
+
+class Mesh;
+
+/*
+ * an instance after the vertex stage, drawn later by Mesh::drawTransformed
+ */
+struct TransformedInstance
+{
+    Mesh* mesh = nullptr;
+    MeshInstance instance;
+    std::vector<float3> positions;           // canonical space, only vertices of the ranges are set
+    std::vector<float3> normals;             // world space
+    std::vector<float> inverseW;             // 1 / clip w, for perspective correct attributes
+    std::vector<std::pair<size_t, size_t>> ranges;   // triangles left after culling
+    std::vector<uint8_t> used;               // vertices referenced by the ranges
+    std::vector<std::vector<Rasterizer::PreparedTriangle>> triangles;   // front facing triangles per setup span, in triangle order
+    bool setUp = false;                      // triangles are filled, else drawTransformed sets up the ranges itself
+};
 
 class Mesh {
 public:
     Mesh(int vSize, int tSize, Vertex center);
 
+    /*
+     * mesh from loaded data, normals and texture coordinates are kept when present
+     */
+    Mesh(std::vector<Vertex> vertices, std::vector<int3> indices, bool hasNormals, bool hasTextureCoords);
+
 public:
     void draw(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, Light& light);
 
     void drawVertex(Rasterizer &rasterizer, VertexProcessor &vertexProcessor, Light& light);
 
+    /*
+     * draws shared geometry once per instance, instances are binned by texture and light
+     */
+    void drawInstanced(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, const std::vector<MeshInstance>& instances);
+
+    /*
+     * transform, cull and draw a single instance with the currently bound texture
+     */
+    void drawInstance(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, const MeshInstance& instance);
+
+    /*
+     * depth only draw of a single instance, texture and light are ignored
+     */
+    void drawInstanceDepth(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, const MeshInstance& instance);
+
+    /*
+     * vertex stage of drawInstance into a buffer, needs no rasterizer so it can run ahead of drawing,
+     * meshlet occlusion culling is skipped since it reads the depth buffer, false when the instance is culled
+     */
+    bool transformInstance(VertexProcessor& vertexProcessor, const MeshInstance& instance, TransformedInstance& transformed);
+
+    /*
+     * the steps of transformInstance, cullInstance sets the ranges and marks their vertices, then
+     * transformVertices runs on spans of the vertex indices, disjoint spans may run on different threads
+     * with processors whose object to world matrix is the instance transform
+     */
+    bool cullInstance(VertexProcessor& vertexProcessor, const MeshInstance& instance, TransformedInstance& transformed);
+
+    void transformVertices(const VertexProcessor& vertexProcessor, TransformedInstance& transformed, size_t first, size_t last) const;
+
+    /*
+     * Rasterizer::prepareTriangle for the triangles of [first, last) into triangles, their vertices must be
+     * transformed, disjoint spans can be set up on different threads into different vectors
+     */
+    void setupTriangles(const Rasterizer& rasterizer, const TransformedInstance& transformed, size_t first, size_t last, std::vector<Rasterizer::PreparedTriangle>& triangles) const;
+
+    /*
+     * rasterizes a buffer from transformInstance with the currently bound texture, from the prepared
+     * triangles when setUp
+     */
+    void drawTransformed(Rasterizer& rasterizer, const TransformedInstance& transformed, bool depthOnly) const;
+
+    /*
+     * computes cached normals, texture coordinates and bounds, geometry must not change afterwards,
+     * a prepared mesh can be drawn from several threads at once
+     */
+    void prepare();
+
+    /*
+     * reorders triangles for the post transform cache and overdraw, then vertices by first use
+     */
+    void optimize(int cacheSize = 16);
+
+    /*
+     * splits the mesh into culled clusters, done by prepare() for meshes of at least minTrianglesForMeshlets
+     */
+    void buildMeshlets(size_t maxTriangles = 124);
+
+    /*
+     * tests every meshlet against the depth buffer before drawing it
+     */
+    void setOcclusionCulling(bool enabled);
+
+    size_t getMeshletCount() const;
+
+    /*
+     * vertex storage once the mesh is prepared, default Full, a packed format releases the full vertices
+     * in prepare() so it has to be set before and optimize() and buildMeshlets() must run before too
+     */
+    void setVertexFormat(VertexFormat format);
+
+    VertexFormat getVertexFormat() const;
+
+    size_t getVertexCount() const;
+
+    /*
+     * decoded from the packed streams for packed formats
+     */
+    Vertex getVertex(size_t index) const;
+
+    /*
+     * bytes of vertex data in the current storage, indices not included
+     */
+    size_t getVertexMemory() const;
+
+    static constexpr size_t minTrianglesForMeshlets = 1024;
+
+    const float3& getBoundingCenter() const;
+
+    float getBoundingRadius() const;
+
+    /*
+     * empty once a mesh with a packed format is prepared, use getVertex()
+     */
+    const std::vector<Vertex>& getVertices() const;
+
+    const std::vector<int3>& getIndices() const;
+
 private:
     void calculateNormals();
 
+    void calculateTextureCoords();
+
+    void calculateBounds();
+
+    bool isPacked() const;
+
+    void drawInstance(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, const MeshInstance& instance, bool depthOnly);
+
+    void drawTriangles(Rasterizer& rasterizer, VertexProcessor& vertexProcessor, const MeshInstance& instance, size_t first, size_t last, bool depthOnly);
+
+    bool isMeshletVisible(const Meshlet& meshlet, const Rasterizer* rasterizer, const VertexProcessor& vertexProcessor) const;
+
+    void transformVertex(const VertexProcessor& vertexProcessor, const float4x4& transform, int index, float3& position, float& inverseW, float3* normal) const;
+
+    void rasterizeTriangles(Rasterizer& rasterizer, const MeshInstance& instance, const float3* positions, const float* inverseW, const float3* normals, size_t first, size_t last, bool depthOnly) const;
+
 protected:
     std::vector<Vertex> mVertices;
     std::vector<int3> mIndices;
     Vertex mCenter;
-};
+    bool mHasNormals = false;
+    bool mHasTextureCoords = false;
 
+private:
+    bool mPrepared = false;
+    float3 mBoundingCenter;
+    float mBoundingRadius = 0.0f;
+    std::vector<Meshlet> mMeshlets;
+    bool mOcclusionCulling = false;
+    VertexFormat mVertexFormat = VertexFormat::Full;
+    PackedVertexBuffer mPackedVertices;
+};
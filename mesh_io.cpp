@@ -0,0 +1,654 @@
+#include "mesh_io.hpp"
+#include "mesh_optimizer.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t streamAlignment = 64;
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// count streams of stride bytes from offset lie past the header and within size, computed without overflow
+bool streamsFit(uint64_t offset, uint64_t stride, uint64_t count, uint64_t size)
+{
+    return offset >= sizeof(BinaryMeshHeader) && offset <= size && stride <= (size - offset) / count;
+}
+
+std::string readFile(const std::string& fname)
+{
+    std::ifstream inp{ fname, std::ios_base::binary };
+    if (!inp)
+    {
+        throw std::runtime_error("Unable to open the mesh file " + fname);
+    }
+    std::string content;
+    inp.seekg(0, std::ios_base::end);
+    content.resize(inp.tellg());
+    inp.seekg(0, std::ios_base::beg);
+    inp.read(&content[0], content.size());
+    return content;
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && isSpace(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+const char* parseFloat(const char* p, const char* end, float& value)
+{
+    p = skipSpaces(p, end);
+    const auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+    {
+        throw std::runtime_error("Malformed number in mesh file");
+    }
+    return result.ptr;
+}
+
+const char* parseInt(const char* p, const char* end, int& value)
+{
+    const auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+    {
+        throw std::runtime_error("Malformed index in mesh file");
+    }
+    return result.ptr;
+}
+
+// OBJ indices are 1-based, negative values are relative to the end of the list
+int resolveObjIndex(int index, size_t count)
+{
+    const int resolved = index < 0 ? (int)count + index : index - 1;
+    if (resolved < 0 || resolved >= (int)count)
+    {
+        throw std::runtime_error("OBJ face index out of range");
+    }
+    return resolved;
+}
+
+struct ObjCorner
+{
+    int position;
+    int textureCoords;
+    int normal;
+
+    bool operator==(const ObjCorner& other) const
+    {
+        return position == other.position && textureCoords == other.textureCoords && normal == other.normal;
+    }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner& corner) const
+    {
+        size_t h = std::hash<int>()(corner.position);
+        h = h * 31 + std::hash<int>()(corner.textureCoords);
+        h = h * 31 + std::hash<int>()(corner.normal);
+        return h;
+    }
+};
+
+// files store counter-clockwise front faces, the rasterizer uses clockwise ones
+void addFan(const std::vector<int>& polygon, std::vector<int3>& indices)
+{
+    for (size_t i = 1; i + 1 < polygon.size(); i++)
+    {
+        indices.push_back(int3{polygon[0], polygon[i + 1], polygon[i]});
+    }
+}
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    bool isList = false;
+    PlyType countType = PlyType::UInt8;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+PlyType parsePlyType(const std::string& name)
+{
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    throw std::runtime_error("Unknown PLY property type " + name);
+}
+
+class PlyReader {
+public:
+    PlyReader(const char* begin, const char* end, bool binary) : mPos(begin), mEnd(end), mBinary(binary) {
+    }
+
+    double read(PlyType type) {
+        if (!mBinary)
+        {
+            mPos = skipWhitespace(mPos);
+            double value = 0.0;
+            const auto result = std::from_chars(mPos, mEnd, value);
+            if (result.ec != std::errc())
+            {
+                throw std::runtime_error("Malformed number in PLY file");
+            }
+            mPos = result.ptr;
+            return value;
+        }
+        switch (type)
+        {
+            case PlyType::Int8: return readBinary<int8_t>();
+            case PlyType::UInt8: return readBinary<uint8_t>();
+            case PlyType::Int16: return readBinary<int16_t>();
+            case PlyType::UInt16: return readBinary<uint16_t>();
+            case PlyType::Int32: return readBinary<int32_t>();
+            case PlyType::UInt32: return readBinary<uint32_t>();
+            case PlyType::Float32: return readBinary<float>();
+            case PlyType::Float64: return readBinary<double>();
+        }
+        return 0.0;
+    }
+
+private:
+    const char* skipWhitespace(const char* p) const {
+        while (p < mEnd && (isSpace(*p) || *p == '\n'))
+        {
+            p++;
+        }
+        return p;
+    }
+
+    template <class T>
+    T readBinary() {
+        if (mPos + sizeof(T) > mEnd)
+        {
+            throw std::runtime_error("Unexpected end of PLY file");
+        }
+        T value;
+        std::memcpy(&value, mPos, sizeof(T));
+        mPos += sizeof(T);
+        return value;
+    }
+
+private:
+    const char* mPos;
+    const char* mEnd;
+    bool mBinary;
+};
+
+int findProperty(const PlyElement& element, std::initializer_list<const char*> names)
+{
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        for (const auto* name : names)
+        {
+            if (element.properties[i].name == name)
+            {
+                return (int)i;
+            }
+        }
+    }
+    return -1;
+}
+
+}
+
+std::shared_ptr<Mesh> loadObj(const std::string &fname) {
+    const std::string content = readFile(fname);
+    const char* p = content.data();
+    const char* end = p + content.size();
+
+    std::vector<float3> positions;
+    std::vector<float3> normals;
+    std::vector<float3> textureCoords;
+    std::vector<Vertex> vertices;
+    std::vector<int3> indices;
+    std::unordered_map<ObjCorner, int, ObjCornerHash> corners;
+    std::vector<int> polygon;
+
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
+        p = skipSpaces(p, lineEnd);
+        if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+        {
+            float x, y, z;
+            p = parseFloat(p + 1, lineEnd, x);
+            p = parseFloat(p, lineEnd, y);
+            parseFloat(p, lineEnd, z);
+            positions.push_back(float3{x, y, z});
+        }
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+        {
+            float x, y, z;
+            p = parseFloat(p + 2, lineEnd, x);
+            p = parseFloat(p, lineEnd, y);
+            parseFloat(p, lineEnd, z);
+            normals.push_back(float3{x, y, z});
+        }
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+        {
+            float u, v = 0.0f;
+            p = parseFloat(p + 2, lineEnd, u);
+            if (skipSpaces(p, lineEnd) < lineEnd)
+            {
+                parseFloat(p, lineEnd, v);
+            }
+            textureCoords.push_back(float3{u, v, 0.0f});
+        }
+        else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+        {
+            polygon.clear();
+            p = skipSpaces(p + 1, lineEnd);
+            while (p < lineEnd)
+            {
+                ObjCorner corner{-1, -1, -1};
+                int index;
+                p = parseInt(p, lineEnd, index);
+                corner.position = resolveObjIndex(index, positions.size());
+                if (p < lineEnd && *p == '/')
+                {
+                    p++;
+                    if (p < lineEnd && *p != '/')
+                    {
+                        p = parseInt(p, lineEnd, index);
+                        corner.textureCoords = resolveObjIndex(index, textureCoords.size());
+                    }
+                    if (p < lineEnd && *p == '/')
+                    {
+                        p = parseInt(p + 1, lineEnd, index);
+                        corner.normal = resolveObjIndex(index, normals.size());
+                    }
+                }
+                const auto inserted = corners.emplace(corner, (int)vertices.size());
+                if (inserted.second)
+                {
+                    Vertex vertex;
+                    vertex.position = positions[corner.position];
+                    if (corner.normal >= 0)
+                    {
+                        vertex.normal = normals[corner.normal];
+                    }
+                    if (corner.textureCoords >= 0)
+                    {
+                        vertex.textureCoords = textureCoords[corner.textureCoords];
+                    }
+                    vertices.push_back(vertex);
+                }
+                polygon.push_back(inserted.first->second);
+                p = skipSpaces(p, lineEnd);
+            }
+            addFan(polygon, indices);
+        }
+        p = lineEnd + 1;
+    }
+
+    return std::make_shared<Mesh>(std::move(vertices), std::move(indices), !normals.empty(), !textureCoords.empty());
+}
+
+std::shared_ptr<Mesh> loadPly(const std::string &fname) {
+    const std::string content = readFile(fname);
+    const size_t headerEnd = content.find("end_header");
+    if (content.compare(0, 3, "ply") != 0 || headerEnd == std::string::npos)
+    {
+        throw std::runtime_error("Error! Unrecognized PLY file format.");
+    }
+
+    std::istringstream header(content.substr(0, headerEnd));
+    std::vector<PlyElement> elements;
+    bool binary = false;
+    std::string line;
+    while (std::getline(header, line))
+    {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format")
+        {
+            std::string format;
+            tokens >> format;
+            if (format == "binary_little_endian")
+            {
+                binary = true;
+            }
+            else if (format != "ascii")
+            {
+                throw std::runtime_error("The program can treat only ascii and binary little endian PLY files");
+            }
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            tokens >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            std::string type;
+            tokens >> type;
+            if (type == "list")
+            {
+                std::string countType;
+                tokens >> countType >> type;
+                property.isList = true;
+                property.countType = parsePlyType(countType);
+            }
+            property.type = parsePlyType(type);
+            tokens >> property.name;
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    size_t dataStart = content.find('\n', headerEnd);
+    dataStart = dataStart == std::string::npos ? content.size() : dataStart + 1;
+    PlyReader reader(content.data() + dataStart, content.data() + content.size(), binary);
+
+    std::vector<Vertex> vertices;
+    std::vector<int3> indices;
+    bool hasNormals = false;
+    bool hasTextureCoords = false;
+    std::vector<double> values;
+    std::vector<int> polygon;
+    for (const auto& element : elements)
+    {
+        const bool isVertex = element.name == "vertex";
+        const bool isFace = element.name == "face";
+        const int x = findProperty(element, {"x"});
+        const int y = findProperty(element, {"y"});
+        const int z = findProperty(element, {"z"});
+        const int nx = findProperty(element, {"nx"});
+        const int ny = findProperty(element, {"ny"});
+        const int nz = findProperty(element, {"nz"});
+        const int u = findProperty(element, {"u", "s", "texture_u"});
+        const int v = findProperty(element, {"v", "t", "texture_v"});
+        const int faceIndices = findProperty(element, {"vertex_indices", "vertex_index"});
+        if (isVertex)
+        {
+            if (x < 0 || y < 0 || z < 0)
+            {
+                throw std::runtime_error("PLY vertices have no position");
+            }
+            hasNormals = nx >= 0 && ny >= 0 && nz >= 0;
+            hasTextureCoords = u >= 0 && v >= 0;
+            vertices.reserve(element.count);
+        }
+        values.resize(element.properties.size());
+        for (size_t i = 0; i < element.count; i++)
+        {
+            for (size_t j = 0; j < element.properties.size(); j++)
+            {
+                const auto& property = element.properties[j];
+                if (!property.isList)
+                {
+                    values[j] = reader.read(property.type);
+                    continue;
+                }
+                const int count = (int)reader.read(property.countType);
+                polygon.clear();
+                for (int k = 0; k < count; k++)
+                {
+                    polygon.push_back((int)reader.read(property.type));
+                }
+                if (isFace && (int)j == faceIndices)
+                {
+                    addFan(polygon, indices);
+                }
+            }
+            if (isVertex)
+            {
+                Vertex vertex;
+                vertex.position = float3{(float)values[x], (float)values[y], (float)values[z]};
+                if (hasNormals)
+                {
+                    vertex.normal = float3{(float)values[nx], (float)values[ny], (float)values[nz]};
+                }
+                if (hasTextureCoords)
+                {
+                    vertex.textureCoords = float3{(float)values[u], (float)values[v], 0.0f};
+                }
+                vertices.push_back(vertex);
+            }
+        }
+    }
+
+    for (const auto& triangle : indices)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (triangle[i] < 0 || triangle[i] >= (int)vertices.size())
+            {
+                throw std::runtime_error("PLY face index out of range");
+            }
+        }
+    }
+    return std::make_shared<Mesh>(std::move(vertices), std::move(indices), hasNormals, hasTextureCoords);
+}
+
+MappedBinaryMesh::MappedBinaryMesh(const std::string &fname) {
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Unable to open the mesh file " + fname);
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(BinaryMeshHeader))
+    {
+        close(fd);
+        throw std::runtime_error("Error! Unrecognized binary mesh format.");
+    }
+    mSize = info.st_size;
+    void* mapping = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Unable to map the mesh file " + fname);
+    }
+    mData = static_cast<const uint8_t*>(mapping);
+
+    const auto& header = getHeader();
+    const uint64_t indexBytes = (uint64_t)header.triangleCount * 3 * header.indexSize;
+    // every stream the accessors hand out has to lie inside the mapping
+    const bool valid = std::memcmp(header.magic, BinaryMeshHeader().magic, sizeof(header.magic)) == 0 && header.version == 1 &&
+        (header.indexSize == 2 || header.indexSize == 4) && header.indicesOffset <= mSize && indexBytes <= mSize - header.indicesOffset &&
+        header.componentStride >= (uint64_t)header.vertexCount * sizeof(float) &&
+        streamsFit(header.positionsOffset, header.componentStride, 3, mSize) &&
+        (header.normalsOffset == 0 ? !(header.flags & BinaryMeshHasNormals) : streamsFit(header.normalsOffset, header.componentStride, 3, mSize)) &&
+        (header.textureCoordsOffset == 0 ? !(header.flags & BinaryMeshHasTextureCoords) : streamsFit(header.textureCoordsOffset, header.componentStride, 2, mSize));
+    if (!valid)
+    {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+        throw std::runtime_error("Error! Unrecognized binary mesh format.");
+    }
+}
+
+MappedBinaryMesh::~MappedBinaryMesh() {
+    munmap(const_cast<uint8_t*>(mData), mSize);
+}
+
+const BinaryMeshHeader &MappedBinaryMesh::getHeader() const {
+    return *reinterpret_cast<const BinaryMeshHeader*>(mData);
+}
+
+const float *MappedBinaryMesh::stream(uint64_t offset, int component) const {
+    if (offset == 0)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<const float*>(mData + offset + component * getHeader().componentStride);
+}
+
+const float *MappedBinaryMesh::getPositions(int component) const {
+    return stream(getHeader().positionsOffset, component);
+}
+
+const float *MappedBinaryMesh::getNormals(int component) const {
+    return stream(getHeader().normalsOffset, component);
+}
+
+const float *MappedBinaryMesh::getTextureCoords(int component) const {
+    return stream(getHeader().textureCoordsOffset, component);
+}
+
+const uint16_t *MappedBinaryMesh::getIndices16() const {
+    return getHeader().indexSize == 2 ? reinterpret_cast<const uint16_t*>(mData + getHeader().indicesOffset) : nullptr;
+}
+
+const uint32_t *MappedBinaryMesh::getIndices32() const {
+    return getHeader().indexSize == 4 ? reinterpret_cast<const uint32_t*>(mData + getHeader().indicesOffset) : nullptr;
+}
+
+std::shared_ptr<Mesh> MappedBinaryMesh::toMesh() const {
+    const auto& header = getHeader();
+    std::vector<Vertex> vertices(header.vertexCount);
+    const float* px = getPositions(0);
+    const float* py = getPositions(1);
+    const float* pz = getPositions(2);
+    const float* nx = getNormals(0);
+    const float* ny = getNormals(1);
+    const float* nz = getNormals(2);
+    const float* u = getTextureCoords(0);
+    const float* v = getTextureCoords(1);
+    for (uint32_t i = 0; i < header.vertexCount; i++)
+    {
+        vertices[i].position = float3{px[i], py[i], pz[i]};
+        if (nx)
+        {
+            vertices[i].normal = float3{nx[i], ny[i], nz[i]};
+        }
+        if (u)
+        {
+            vertices[i].textureCoords = float3{u[i], v[i], 0.0f};
+        }
+    }
+
+    std::vector<int3> indices(header.triangleCount);
+    const uint16_t* indices16 = getIndices16();
+    const uint32_t* indices32 = getIndices32();
+    for (uint32_t i = 0; i < header.triangleCount; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            const uint32_t index = indices16 ? indices16[3 * i + j] : indices32[3 * i + j];
+            if (index >= header.vertexCount)
+            {
+                throw std::runtime_error("Binary mesh index out of range");
+            }
+            indices[i][j] = (int)index;
+        }
+    }
+    return std::make_shared<Mesh>(std::move(vertices), std::move(indices), nx != nullptr, u != nullptr);
+}
+
+std::shared_ptr<Mesh> loadBinaryMesh(const std::string &fname) {
+    return MappedBinaryMesh(fname).toMesh();
+}
+
+std::shared_ptr<Mesh> loadMesh(const std::string &fname) {
+    std::string extension = fname.substr(std::min(fname.size(), fname.find_last_of('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == ".obj")
+    {
+        return loadObj(fname);
+    }
+    if (extension == ".ply")
+    {
+        return loadPly(fname);
+    }
+    if (extension == ".rmesh")
+    {
+        return loadBinaryMesh(fname);
+    }
+    throw std::runtime_error("Unsupported mesh file " + fname);
+}
+
+void writeBinaryMesh(Mesh &mesh, const std::string &fname) {
+    mesh.prepare();
+    const size_t vertexCount = mesh.getVertexCount();
+    const auto& indices = mesh.getIndices();
+
+    const CompactIndexBuffer indexBuffer(indices);
+
+    BinaryMeshHeader header;
+    header.vertexCount = vertexCount;
+    header.triangleCount = indices.size();
+    header.indexSize = indexBuffer.is16Bit() ? 2 : 4;
+    header.flags = BinaryMeshHasNormals | BinaryMeshHasTextureCoords;
+    header.componentStride = alignUp(vertexCount * sizeof(float), streamAlignment);
+    header.positionsOffset = alignUp(sizeof(BinaryMeshHeader), streamAlignment);
+    header.normalsOffset = header.positionsOffset + 3 * header.componentStride;
+    header.textureCoordsOffset = header.normalsOffset + 3 * header.componentStride;
+    header.indicesOffset = header.textureCoordsOffset + 2 * header.componentStride;
+    const uint64_t fileSize = header.indicesOffset + indexBuffer.sizeInBytes();
+
+    std::vector<uint8_t> data(fileSize, 0);
+    std::memcpy(data.data(), &header, sizeof(header));
+    auto component = [&](uint64_t offset, int c) {
+        return reinterpret_cast<float*>(data.data() + offset + c * header.componentStride);
+    };
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const auto vertex = mesh.getVertex(i);
+        for (int c = 0; c < 3; c++)
+        {
+            component(header.positionsOffset, c)[i] = vertex.position[c];
+            component(header.normalsOffset, c)[i] = vertex.normal[c];
+        }
+        for (int c = 0; c < 2; c++)
+        {
+            component(header.textureCoordsOffset, c)[i] = vertex.textureCoords[c];
+        }
+    }
+    if (indexBuffer.is16Bit())
+    {
+        std::memcpy(data.data() + header.indicesOffset, indexBuffer.indices16.data(), indexBuffer.sizeInBytes());
+    }
+    else
+    {
+        std::memcpy(data.data() + header.indicesOffset, indexBuffer.indices32.data(), indexBuffer.sizeInBytes());
+    }
+
+    std::ofstream of{ fname, std::ios_base::binary };
+    if (!of)
+    {
+        throw std::runtime_error("Unable to open the output mesh file.");
+    }
+    of.write((const char*)data.data(), data.size());
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "mesh.hpp"
+
+/*
+ * binary mesh file, every stream starts at a 64 byte aligned offset so a mapped file can be used in place:
+ * positions x[] y[] z[], normals x[] y[] z[], texture coords u[] v[], then 16 or 32 bit triangle indices
+ */
+struct BinaryMeshHeader {
+    char magic[4]{ 'R', 'M', 'S', 'H' };
+    uint32_t version{ 1 };
+    uint32_t vertexCount{ 0 };
+    uint32_t triangleCount{ 0 };
+    uint32_t indexSize{ 4 };                 // 2 or 4 bytes
+    uint32_t flags{ 0 };                     // BinaryMeshFlags
+    uint64_t positionsOffset{ 0 };
+    uint64_t normalsOffset{ 0 };             // 0 if the mesh has no normals
+    uint64_t textureCoordsOffset{ 0 };       // 0 if the mesh has no texture coordinates
+    uint64_t indicesOffset{ 0 };
+    uint64_t componentStride{ 0 };           // bytes between x[], y[] and z[] streams
+};
+
+enum BinaryMeshFlags : uint32_t {
+    BinaryMeshHasNormals = 1u << 0,
+    BinaryMeshHasTextureCoords = 1u << 1,
+};
+
+/*
+ * read only mapping of a binary mesh file
+ */
+class MappedBinaryMesh {
+public:
+    explicit MappedBinaryMesh(const std::string& fname);
+
+    ~MappedBinaryMesh();
+
+    MappedBinaryMesh(const MappedBinaryMesh&) = delete;
+
+    MappedBinaryMesh& operator=(const MappedBinaryMesh&) = delete;
+
+    const BinaryMeshHeader& getHeader() const;
+
+    const float* getPositions(int component) const;
+
+    const float* getNormals(int component) const;
+
+    const float* getTextureCoords(int component) const;
+
+    const uint16_t* getIndices16() const;
+
+    const uint32_t* getIndices32() const;
+
+    std::shared_ptr<Mesh> toMesh() const;
+
+private:
+    const float* stream(uint64_t offset, int component) const;
+
+private:
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+};
+
+std::shared_ptr<Mesh> loadObj(const std::string& fname);
+
+/*
+ * ascii and binary little endian PLY files
+ */
+std::shared_ptr<Mesh> loadPly(const std::string& fname);
+
+std::shared_ptr<Mesh> loadBinaryMesh(const std::string& fname);
+
+/*
+ * picks the loader from the file extension: .obj, .ply or .rmesh
+ */
+std::shared_ptr<Mesh> loadMesh(const std::string& fname);
+
+/*
+ * prepares the mesh and stores it with normals and texture coordinates, 16 bit indices are used when they fit
+ */
+void writeBinaryMesh(Mesh& mesh, const std::string& fname);
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "mesh_io.hpp"
+#include "mesh_optimizer.hpp"
+#include "sphere.hpp"
+
+namespace {
+
+long currentRssKb()
+{
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0;
+    long resident = 0;
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+long peakRssKb()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+template <class F>
+double measureMs(F&& f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* stage, double ms, size_t triangles)
+{
+    std::cout << stage << ": " << ms << " ms, " << triangles / 1000 << "k triangles, rss " << currentRssKb() / 1024
+              << " MB, peak rss " << peakRssKb() / 1024 << " MB" << std::endl;
+}
+
+// tessellated sphere written as OBJ text, used when no asset is given
+std::string writeSyntheticObj(int segments)
+{
+    Vertex center;
+    Sphere sphere(segments, 2 * segments, center, 1.0f);
+    const std::string fname = "mesh_load_bench.obj";
+    std::ofstream of{ fname };
+    for (const auto& vertex : sphere.getVertices())
+    {
+        of << "v " << vertex.position.x() << ' ' << vertex.position.y() << ' ' << vertex.position.z() << '\n';
+    }
+    for (const auto& triangle : sphere.getIndices())
+    {
+        of << "f " << triangle[0] + 1 << ' ' << triangle[2] + 1 << ' ' << triangle[1] + 1 << '\n';
+    }
+    return fname;
+}
+
+}
+
+/*
+ * usage: mesh_load_bench [mesh.obj|mesh.ply]
+ */
+int main(int argc, char** argv) {
+    const std::string source = argc > 1 ? argv[1] : writeSyntheticObj(300);
+    const std::string binary = source + ".rmesh";
+
+    std::shared_ptr<Mesh> mesh;
+    const double textMs = measureMs([&] { mesh = loadMesh(source); });
+    const size_t triangles = mesh->getIndices().size();
+    report("text load", textMs, triangles);
+
+    const auto before = analyzeVertexCache(mesh->getIndices(), mesh->getVertices().size());
+    report("cache and overdraw optimization", measureMs([&] { mesh->optimize(); }), triangles);
+    const auto after = analyzeVertexCache(mesh->getIndices(), mesh->getVertices().size());
+    std::cout << "post transform cache: acmr " << before.acmr << " -> " << after.acmr << ", hit rate " << before.hitRate
+              << " -> " << after.hitRate << std::endl;
+
+    // meshlets are cut from the optimized order in prepare(), which writeBinaryMesh runs as well
+    report("prepare", measureMs([&] { mesh->prepare(); }), triangles);
+    const auto prepared = analyzeVertexCache(mesh->getIndices(), mesh->getVertices().size());
+    std::cout << "after prepare: acmr " << prepared.acmr << ", hit rate " << prepared.hitRate << ", " << mesh->getMeshletCount()
+              << " meshlets" << std::endl;
+
+    report("binary write", measureMs([&] { writeBinaryMesh(*mesh, binary); }), triangles);
+    mesh.reset();
+
+    float checksum = 0.0f;
+    const double mapMs = measureMs([&] {
+        MappedBinaryMesh mapped(binary);
+        const float* x = mapped.getPositions(0);
+        for (uint32_t i = 0; i < mapped.getHeader().vertexCount; i++)
+        {
+            checksum += x[i];
+        }
+    });
+    report("binary map and read positions", mapMs, triangles);
+
+    const double binaryMs = measureMs([&] { mesh = loadBinaryMesh(binary); });
+    report("binary load into mesh", binaryMs, triangles);
+
+    std::cout << "speedup of mapped file over text: " << textMs / mapMs << "x, of binary load into mesh: " << textMs / binaryMs
+              << "x (checksum " << checksum << ")" << std::endl;
+    return 0;
+}
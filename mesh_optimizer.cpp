@@ -0,0 +1,309 @@
+#include "mesh_optimizer.hpp"
+#include <algorithm>
+#include <deque>
+
+namespace {
+
+class FifoCache {
+public:
+    explicit FifoCache(size_t vertexCount, int cacheSize) : mTimestamps(vertexCount, 0), mCacheSize(cacheSize) {
+    }
+
+    // returns true on a cache miss
+    bool access(int vertex) {
+        if (mTimestamps[vertex] != 0 && mTime - mTimestamps[vertex] < (unsigned)mCacheSize)
+        {
+            return false;
+        }
+        mTimestamps[vertex] = ++mTime;
+        return true;
+    }
+
+    void reset() {
+        mTime += mCacheSize;
+    }
+
+private:
+    std::vector<unsigned> mTimestamps;
+    unsigned mTime = 0;
+    int mCacheSize;
+};
+
+}
+
+CompactIndexBuffer::CompactIndexBuffer(const std::vector<int3> &indices) {
+    int maxIndex = 0;
+    for (const auto& triangle : indices)
+    {
+        maxIndex = std::max({maxIndex, triangle[0], triangle[1], triangle[2]});
+    }
+    if (maxIndex <= 0xFFFF)
+    {
+        indices16.reserve(indices.size() * 3);
+        for (const auto& triangle : indices)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                indices16.push_back(triangle[i]);
+            }
+        }
+    }
+    else
+    {
+        indices32.reserve(indices.size() * 3);
+        for (const auto& triangle : indices)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                indices32.push_back(triangle[i]);
+            }
+        }
+    }
+}
+
+bool CompactIndexBuffer::is16Bit() const {
+    return indices32.empty();
+}
+
+size_t CompactIndexBuffer::sizeInBytes() const {
+    return indices16.size() * sizeof(uint16_t) + indices32.size() * sizeof(uint32_t);
+}
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<int3> &indices, size_t vertexCount, int cacheSize) {
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t misses = 0;
+    size_t referencedCount = 0;
+    for (const auto& triangle : indices)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            misses += cache.access(triangle[i]);
+            if (!referenced[triangle[i]])
+            {
+                referenced[triangle[i]] = true;
+                referencedCount++;
+            }
+        }
+    }
+    VertexCacheStatistics statistics{0.0f, 0.0f, 0.0f};
+    if (!indices.empty())
+    {
+        statistics.acmr = (float)misses / indices.size();
+        statistics.atvr = (float)misses / referencedCount;
+        statistics.hitRate = 1.0f - (float)misses / (indices.size() * 3);
+    }
+    return statistics;
+}
+
+std::vector<int3> optimizeVertexCache(const std::vector<int3> &indices, size_t vertexCount, int cacheSize, std::vector<size_t> *clusterStarts) {
+    // vertex to triangle adjacency in compressed form
+    std::vector<int> liveTriangles(vertexCount, 0);
+    for (const auto& triangle : indices)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            liveTriangles[triangle[i]]++;
+        }
+    }
+    std::vector<size_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + liveTriangles[v];
+    }
+    std::vector<size_t> adjacency(offsets.back());
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < indices.size(); t++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            adjacency[fill[indices[t][i]]++] = t;
+        }
+    }
+
+    std::vector<int3> result;
+    result.reserve(indices.size());
+    std::vector<bool> emitted(indices.size(), false);
+    std::vector<int> cacheTime(vertexCount, 0);
+    std::vector<int> deadEnd;
+    std::vector<int> candidates;
+    int time = cacheSize + 1;
+    size_t cursor = 0;
+    int fanning = vertexCount > 0 ? 0 : -1;
+    bool startCluster = true;
+
+    while (fanning >= 0)
+    {
+        if (startCluster && clusterStarts)
+        {
+            clusterStarts->push_back(result.size());
+        }
+        candidates.clear();
+        for (size_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+        {
+            const size_t t = adjacency[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                const int v = indices[t][i];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = true;
+            result.push_back(indices[t]);
+        }
+
+        // next fanning vertex: the one staying longest in cache that still has live triangles
+        int next = -1;
+        int bestPriority = -1;
+        for (const int v : candidates)
+        {
+            if (liveTriangles[v] <= 0)
+            {
+                continue;
+            }
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+            {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        startCluster = next < 0;
+        while (next < 0 && !deadEnd.empty())
+        {
+            const int d = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[d] > 0)
+            {
+                next = d;
+            }
+        }
+        while (next < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+            {
+                next = (int)cursor;
+            }
+            cursor++;
+        }
+        fanning = next;
+    }
+    return result;
+}
+
+std::vector<int3> optimizeOverdraw(const std::vector<int3> &indices, const std::vector<Vertex> &vertices, const std::vector<size_t> &clusterStarts, int cacheSize, float threshold) {
+    if (indices.empty())
+    {
+        return indices;
+    }
+    const float meshAcmr = analyzeVertexCache(indices, vertices.size(), cacheSize).acmr;
+
+    // merge dead end runs until their own cache efficiency is close to the whole mesh
+    std::vector<size_t> boundaries;
+    FifoCache cache(vertices.size(), cacheSize);
+    size_t clusterMisses = 0;
+    size_t clusterStart = 0;
+    size_t nextStart = 0;
+    for (size_t t = 0; t < indices.size(); t++)
+    {
+        while (nextStart < clusterStarts.size() && clusterStarts[nextStart] < t)
+        {
+            nextStart++;
+        }
+        const bool hardBoundary = nextStart < clusterStarts.size() && clusterStarts[nextStart] == t;
+        if (t > clusterStart && hardBoundary && (float)clusterMisses / (t - clusterStart) <= meshAcmr * threshold)
+        {
+            boundaries.push_back(clusterStart);
+            clusterStart = t;
+            clusterMisses = 0;
+            cache.reset();
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            clusterMisses += cache.access(indices[t][i]);
+        }
+    }
+    boundaries.push_back(clusterStart);
+    boundaries.push_back(indices.size());
+
+    float3 meshCentroid{0.0f, 0.0f, 0.0f};
+    for (const auto& vertex : vertices)
+    {
+        meshCentroid += vertex.position;
+    }
+    meshCentroid /= std::max<size_t>(vertices.size(), 1);
+
+    struct Cluster
+    {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < boundaries.size(); c++)
+    {
+        float3 centroid{0.0f, 0.0f, 0.0f};
+        float3 normal{0.0f, 0.0f, 0.0f};
+        float weight = 0.0f;
+        for (size_t t = boundaries[c]; t < boundaries[c + 1]; t++)
+        {
+            const auto& p0 = vertices[indices[t][0]].position;
+            const auto& p1 = vertices[indices[t][1]].position;
+            const auto& p2 = vertices[indices[t][2]].position;
+            // area weighted, same winding as Mesh::calculateNormals
+            const float3 n = crossProduct(p2 - p0, p1 - p0);
+            const float area = n.length();
+            normal += n;
+            centroid += (p0 + p1 + p2) * (area / 3.0f);
+            weight += area;
+        }
+        // the summed normal shrinks on curved clusters, only its direction is used
+        const float length = normal.length();
+        const float key = weight > 0.0f && length > 0.0f ? (centroid / weight - meshCentroid).dotProduct(normal / length) : 0.0f;
+        clusters.push_back({boundaries[c], boundaries[c + 1], key});
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<int3> result;
+    result.reserve(indices.size());
+    for (const auto& cluster : clusters)
+    {
+        result.insert(result.end(), indices.begin() + cluster.begin, indices.begin() + cluster.end);
+    }
+    return result;
+}
+
+std::vector<Vertex> optimizeVertexFetch(const std::vector<Vertex> &vertices, std::vector<int3> &indices) {
+    std::vector<int> remap(vertices.size(), -1);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (auto& triangle : indices)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            int& index = triangle[i];
+            if (remap[index] < 0)
+            {
+                remap[index] = (int)result.size();
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vector.hpp"
+#include "vertex.hpp"
+
+struct VertexCacheStatistics
+{
+    float acmr;          // transformed vertices per triangle
+    float atvr;          // transformed vertices per referenced vertex
+    float hitRate;       // fraction of indices found in the post transform cache
+};
+
+/*
+ * index buffer narrowed to 16 bits when every index fits, the index stream of writeBinaryMesh,
+ * Mesh keeps and draws from int3 indices since getIndices() hands them out to every consumer
+ */
+struct CompactIndexBuffer
+{
+    std::vector<uint16_t> indices16;
+    std::vector<uint32_t> indices32;
+
+    explicit CompactIndexBuffer(const std::vector<int3>& indices);
+
+    bool is16Bit() const;
+
+    size_t sizeInBytes() const;
+};
+
+/*
+ * FIFO post transform cache simulation
+ */
+VertexCacheStatistics analyzeVertexCache(const std::vector<int3>& indices, size_t vertexCount, int cacheSize = 16);
+
+/*
+ * Tipsify triangle reordering, clusterStarts receives the first triangle of every run ending in a dead end
+ */
+std::vector<int3> optimizeVertexCache(const std::vector<int3>& indices, size_t vertexCount, int cacheSize = 16, std::vector<size_t>* clusterStarts = nullptr);
+
+/*
+ * splits a cache optimized order into clusters whose cache efficiency stays within threshold of the whole mesh
+ * and sorts them so outward facing clusters are drawn first
+ */
+std::vector<int3> optimizeOverdraw(const std::vector<int3>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusterStarts, int cacheSize = 16, float threshold = 1.05f);
+
+/*
+ * reorders vertices by first use and drops unreferenced ones, indices are remapped in place
+ */
+std::vector<Vertex> optimizeVertexFetch(const std::vector<Vertex>& vertices, std::vector<int3>& indices);
@@ -0,0 +1,117 @@
+#include "meshlet.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+Meshlet calculateBounds(const std::vector<Vertex>& vertices, const std::vector<int3>& indices, size_t first, size_t count)
+{
+    Meshlet meshlet{first, count, float3{0.0f, 0.0f, 0.0f}, 0.0f, float3{0.0f, 0.0f, 0.0f}, 0.0f};
+    float3 minCorner = vertices[indices[first][0]].position;
+    float3 maxCorner = minCorner;
+    std::vector<float3> normals;
+    normals.reserve(count);
+    for (size_t t = first; t < first + count; t++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            const auto& p = vertices[indices[t][i]].position;
+            for (int c = 0; c < 3; c++)
+            {
+                minCorner[c] = std::min(minCorner[c], p[c]);
+                maxCorner[c] = std::max(maxCorner[c], p[c]);
+            }
+        }
+        const auto& p0 = vertices[indices[t][0]].position;
+        const auto& p1 = vertices[indices[t][1]].position;
+        const auto& p2 = vertices[indices[t][2]].position;
+        // same winding as Mesh::calculateNormals
+        float3 n = crossProduct(p2 - p0, p1 - p0);
+        const float len = n.length();
+        if (len > 0.0f)
+        {
+            n /= len;
+            normals.push_back(n);
+            meshlet.coneAxis += n;
+        }
+    }
+    meshlet.center = (minCorner + maxCorner) * 0.5f;
+    for (size_t t = first; t < first + count; t++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            meshlet.radius = std::max(meshlet.radius, (vertices[indices[t][i]].position - meshlet.center).length());
+        }
+    }
+
+    const float axisLength = meshlet.coneAxis.length();
+    if (normals.empty() || axisLength <= 1.0e-4f)
+    {
+        meshlet.coneCutoff = 0.0f;
+        return meshlet;
+    }
+    meshlet.coneAxis /= axisLength;
+    meshlet.coneCutoff = 1.0f;
+    for (const auto& n : normals)
+    {
+        meshlet.coneCutoff = std::min(meshlet.coneCutoff, n.dotProduct(meshlet.coneAxis));
+    }
+    return meshlet;
+}
+
+}
+
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex> &vertices, const std::vector<int3> &indices, size_t maxTriangles) {
+    // a triangle sharing no vertex with the open meshlet ends it, unless that would leave it smaller than this
+    const size_t minTriangles = std::max(maxTriangles / 4, (size_t)1);
+    std::vector<size_t> vertexMeshlet(vertices.size(), 0);   // 1 + index of the last meshlet using the vertex
+    std::vector<Meshlet> meshlets;
+    size_t first = 0;
+    for (size_t t = 0; t < indices.size(); t++)
+    {
+        const auto& triangle = indices[t];
+        const size_t current = meshlets.size() + 1;
+        const bool connected = vertexMeshlet[triangle[0]] == current || vertexMeshlet[triangle[1]] == current || vertexMeshlet[triangle[2]] == current;
+        if (t - first == maxTriangles || (t - first >= minTriangles && !connected))
+        {
+            meshlets.push_back(calculateBounds(vertices, indices, first, t - first));
+            first = t;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            vertexMeshlet[triangle[i]] = meshlets.size() + 1;
+        }
+    }
+    if (first < indices.size())
+    {
+        meshlets.push_back(calculateBounds(vertices, indices, first, indices.size() - first));
+    }
+    return meshlets;
+}
+
+bool isMeshletBackFacing(const Meshlet &meshlet, const VertexProcessor &vertexProcessor) {
+    if (meshlet.coneCutoff <= 0.0f)
+    {
+        return false;
+    }
+    // camera is the origin of view space
+    const float3 center = vertexProcessor.convertToView(meshlet.center);
+    float3 axis = vertexProcessor.convertDirectionToView(meshlet.coneAxis);
+    const float distance = center.length();
+    const float radius = meshlet.radius * vertexProcessor.maxScale();
+    const float axisLength = axis.length();
+    if (distance <= radius || axisLength <= 0.0f)
+    {
+        return false;
+    }
+    axis /= axisLength;
+    // Rasterizer::fillTriangle only accepts one screen space winding, with the Mesh::calculateNormals convention
+    // it rejects triangles whose normal points towards the camera, so every normal within the cone
+    // has to point towards every point within the sphere
+    const float spread = acosf(std::min(meshlet.coneCutoff, 1.0f)) + asinf(radius / distance);
+    if (spread >= M_PI_2f32)
+    {
+        return false;
+    }
+    return -(center / distance).dotProduct(axis) > sinf(spread);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include "vector.hpp"
+#include "vertex.hpp"
+#include "vertex_processor.hpp"
+
+/*
+ * contiguous range of a mesh index buffer with bounds used to cull it as a whole
+ */
+struct Meshlet
+{
+    size_t firstTriangle;
+    size_t triangleCount;
+    float3 center;
+    float radius;
+    float3 coneAxis;
+    float coneCutoff;    // cosine of the widest angle between the axis and a triangle normal, <= 0 disables the cone test
+};
+
+/*
+ * cuts the index buffer into meshlets of at most maxTriangles consecutive triangles, a meshlet also ends where
+ * the triangle order leaves its vertices, the order itself is kept so the vertex cache optimization survives
+ */
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices, const std::vector<int3>& indices, size_t maxTriangles = 124);
+
+/*
+ * true when the rasterizer would reject every triangle of the meshlet by its winding, uses current VertexProcessor matrices
+ */
+bool isMeshletBackFacing(const Meshlet& meshlet, const VertexProcessor& vertexProcessor);
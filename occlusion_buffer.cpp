@@ -0,0 +1,216 @@
+#include "occlusion_buffer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "mesh.hpp"
+#include "rasterizer.hpp"
+#include "render_stats.hpp"
+
+namespace {
+
+// covers the float rounding of the depth interpolation in the rasterizer
+constexpr float depthTolerance = 1.0e-5f;
+
+// occluder vertices further out are dropped before the integer edge functions could overflow
+constexpr float maxCanonical = 64.0f;
+
+}
+
+void OcclusionBuffer::reset(int width, int height, int samples) {
+    mWidth = width;
+    mHeight = height;
+    mSamples = samples;
+    mColumns = (width + cellSize - 1) / cellSize;
+    mRows = (height + cellSize - 1) / cellSize;
+    mDepth.assign((size_t)mColumns * mRows, std::numeric_limits<float>::infinity());
+    mCoverage.resize(mDepth.size() * samples);
+    mCoverageDepth.assign(mDepth.size(), -std::numeric_limits<float>::infinity());
+    for (int row = 0; row < mRows; row++)
+    {
+        for (int column = 0; column < mColumns; column++)
+        {
+            const size_t cell = (size_t)row * mColumns + column;
+            std::fill_n(mCoverage.begin() + cell * samples, samples, outsideMask(column, row));
+        }
+    }
+}
+
+void OcclusionBuffer::drawOccluder(const Mesh &mesh, const VertexProcessor &vertexProcessor) {
+    RENDER_STATS_SCOPE("OcclusionBuffer::drawOccluder");
+    const size_t count = mesh.getVertexCount();
+    mPositions.resize(count);
+    mInFront.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        float inverseW;
+        mPositions[i] = vertexProcessor.convertToCanonical(mesh.getVertex(i).position, inverseW);
+        mInFront[i] = inverseW > 0.0f && std::fabs(mPositions[i].x()) < maxCanonical && std::fabs(mPositions[i].y()) < maxCanonical;
+    }
+    for (const auto& triangle : mesh.getIndices())
+    {
+        if (mInFront[triangle[0]] && mInFront[triangle[1]] && mInFront[triangle[2]])
+        {
+            drawTriangle(mPositions[triangle[0]], mPositions[triangle[1]], mPositions[triangle[2]]);
+        }
+    }
+}
+
+void OcclusionBuffer::drawTriangle(const float3 &p1, const float3 &p2, const float3 &p3) {
+    const int64_t x1 = toPixelX(p1.x());
+    const int64_t y1 = toPixelY(p1.y());
+    const int64_t x2 = toPixelX(p2.x());
+    const int64_t y2 = toPixelY(p2.y());
+    const int64_t x3 = toPixelX(p3.x());
+    const int64_t y3 = toPixelY(p3.y());
+    // edge functions, winding and top-left rule of the rasterizer
+    const int64_t dx12 = x1 - x2;
+    const int64_t dx23 = x2 - x3;
+    const int64_t dx31 = x3 - x1;
+    const int64_t dy12 = y1 - y2;
+    const int64_t dy23 = y2 - y3;
+    const int64_t dy31 = y3 - y1;
+    const int64_t area = dy23 * (x1 - x3) - dx23 * (y1 - y3);
+    if (area >= 0)
+    {
+        return;
+    }
+    const int64_t bias1 = dy12 < 0 || (dy12 == 0 && dx12 > 0) ? 0 : -1;
+    const int64_t bias2 = dy23 < 0 || (dy23 == 0 && dx23 > 0) ? 0 : -1;
+    const int64_t bias3 = dy31 < 0 || (dy31 == 0 && dx31 > 0) ? 0 : -1;
+    int offsets[8][2];
+    for (int s = 0; s < mSamples; s++)
+    {
+        Rasterizer::getSampleOffset(mSamples, s, offsets[s][0], offsets[s][1]);
+    }
+    const float farthestVertex = std::max({p1.z(), p2.z(), p3.z()});
+
+    // samples reach half a pixel beyond the pixel bounding box
+    const int minX = (int)std::max(std::min({x1, x2, x3}) - 1, (int64_t)0);
+    const int minY = (int)std::max(std::min({y1, y2, y3}) - 1, (int64_t)0);
+    const int maxX = (int)std::min(std::max({x1, x2, x3}) + 1, (int64_t)mWidth - 1);
+    const int maxY = (int)std::min(std::max({y1, y2, y3}) + 1, (int64_t)mHeight - 1);
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+    const double inverseArea = 1.0 / area;
+    for (int row = minY / cellSize; row <= maxY / cellSize; row++)
+    {
+        for (int column = minX / cellSize; column <= maxX / cellSize; column++)
+        {
+            const size_t cell = (size_t)row * mColumns + column;
+            // a square one pixel larger than the cell holds every sample of its pixels
+            bool inside = true;
+            double farthest = -std::numeric_limits<double>::infinity();
+            for (int corner = 0; corner < 4; corner++)
+            {
+                const int64_t x = (corner & 1) ? (int64_t)(column + 1) * cellSize : (int64_t)column * cellSize - 1;
+                const int64_t y = (corner >> 1) ? (int64_t)(row + 1) * cellSize : (int64_t)row * cellSize - 1;
+                const int64_t edge1 = dx12 * (y - y1) - dy12 * (x - x1);
+                const int64_t edge2 = dx23 * (y - y2) - dy23 * (x - x2);
+                const int64_t edge3 = dx31 * (y - y3) - dy31 * (x - x3);
+                inside = inside && edge1 > 0 && edge2 > 0 && edge3 > 0;
+                // the depth is a plane, over the square it is bounded by the corners
+                const double lambda1 = -edge2 * inverseArea;
+                const double lambda2 = -edge3 * inverseArea;
+                farthest = std::max(farthest, lambda1 * p1.z() + lambda2 * p2.z() + (1.0 - lambda1 - lambda2) * p3.z());
+            }
+            const float bound = std::min(farthestVertex, (float)farthest);
+            if (inside)
+            {
+                commitDepth(cell, bound);
+                continue;
+            }
+
+            // partial cover, the samples are merged with the other triangles in the cell
+            const int cellMinX = std::max(column * cellSize, minX);
+            const int cellMaxX = std::min(column * cellSize + cellSize - 1, maxX);
+            const int cellMinY = std::max(row * cellSize, minY);
+            const int cellMaxY = std::min(row * cellSize + cellSize - 1, maxY);
+            uint64_t* coverage = &mCoverage[cell * mSamples];
+            bool any = false;
+            for (int s = 0; s < mSamples; s++)
+            {
+                uint64_t bits = 0;
+                for (int y = cellMinY; y <= cellMaxY; y++)
+                {
+                    for (int x = cellMinX; x <= cellMaxX; x++)
+                    {
+                        const int64_t sx = (int64_t)x * Rasterizer::sampleScale + offsets[s][0];
+                        const int64_t sy = (int64_t)y * Rasterizer::sampleScale + offsets[s][1];
+                        const int64_t edge1 = dx12 * (sy - y1 * Rasterizer::sampleScale) - dy12 * (sx - x1 * Rasterizer::sampleScale);
+                        const int64_t edge2 = dx23 * (sy - y2 * Rasterizer::sampleScale) - dy23 * (sx - x2 * Rasterizer::sampleScale);
+                        const int64_t edge3 = dx31 * (sy - y3 * Rasterizer::sampleScale) - dy31 * (sx - x3 * Rasterizer::sampleScale);
+                        if (((edge1 + bias1) | (edge2 + bias2) | (edge3 + bias3)) >= 0)
+                        {
+                            bits |= 1ull << ((y - row * cellSize) * cellSize + x - column * cellSize);
+                        }
+                    }
+                }
+                coverage[s] |= bits;
+                any = any || bits != 0;
+            }
+            if (!any)
+            {
+                continue;
+            }
+            mCoverageDepth[cell] = std::max(mCoverageDepth[cell], bound);
+            if (std::all_of(coverage, coverage + mSamples, [](uint64_t word) { return word == ~0ull; }))
+            {
+                commitDepth(cell, mCoverageDepth[cell]);
+                std::fill_n(coverage, mSamples, outsideMask(column, row));
+                mCoverageDepth[cell] = -std::numeric_limits<float>::infinity();
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::commitDepth(size_t cell, float depth) {
+    mDepth[cell] = std::min(mDepth[cell], depth + depthTolerance);
+}
+
+uint64_t OcclusionBuffer::outsideMask(int column, int row) const {
+    uint64_t mask = 0;
+    for (int y = 0; y < cellSize; y++)
+    {
+        for (int x = 0; x < cellSize; x++)
+        {
+            if (column * cellSize + x >= mWidth || row * cellSize + y >= mHeight)
+            {
+                mask |= 1ull << (y * cellSize + x);
+            }
+        }
+    }
+    return mask;
+}
+
+bool OcclusionBuffer::isOccluded(const ScreenBounds &bounds) const {
+    // pixel rectangle of Rasterizer::getPixelBounds
+    const int minX = std::max(toPixelX(std::max(bounds.minX, -2.0f)) - 1, 0);
+    const int minY = std::max(toPixelY(std::min(bounds.maxY, 2.0f)) - 1, 0);
+    const int maxX = std::min(toPixelX(std::min(bounds.maxX, 2.0f)) + 1, mWidth - 1);
+    const int maxY = std::min(toPixelY(std::max(bounds.minY, -2.0f)) + 1, mHeight - 1);
+    if (minX > maxX || minY > maxY)
+    {
+        return false;
+    }
+    for (int row = minY / cellSize; row <= maxY / cellSize; row++)
+    {
+        for (int column = minX / cellSize; column <= maxX / cellSize; column++)
+        {
+            if (!(mDepth[(size_t)row * mColumns + column] < bounds.minDepth))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int OcclusionBuffer::toPixelX(float x) const {
+    return (x+1)*mWidth *0.5f;
+}
+
+int OcclusionBuffer::toPixelY(float y) const {
+    return mHeight - ((y+1)*mHeight *0.5f);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vertex_processor.hpp"
+
+class Mesh;
+
+/*
+ * coarse depth buffer for occlusion culling, one cell per cellSize x cellSize pixels of the render target,
+ * occluder triangles are merged per cell until they cover every sample of it with the coverage rules of the
+ * rasterizer, the cell then keeps the farthest depth among them, so bounds found behind a cell are hidden
+ * at full resolution as well
+ */
+class OcclusionBuffer {
+public:
+    /*
+     * sizes the cells for a width x height target with the given samples per pixel and empties them
+     */
+    void reset(int width, int height, int samples);
+
+    /*
+     * front facing triangles of the mesh placed by the object to world matrix of the processor,
+     * triangles reaching behind the camera are left out
+     */
+    void drawOccluder(const Mesh& mesh, const VertexProcessor& vertexProcessor);
+
+    /*
+     * canonical space triangle, clockwise like Rasterizer::drawTriangle
+     */
+    void drawTriangle(const float3& p1, const float3& p2, const float3& p3);
+
+    /*
+     * true when every cell under the bounds holds an occluder nearer than the bounds
+     */
+    bool isOccluded(const ScreenBounds& bounds) const;
+
+    static constexpr int cellSize = 8;       // a cell's pixels are the bits of one mask word per sample
+
+private:
+    // the same snapping as Rasterizer::toPixelX and toPixelY
+    int toPixelX(float x) const;
+
+    int toPixelY(float y) const;
+
+    // bits of the pixels of a cell lying outside the target, they count as covered
+    uint64_t outsideMask(int column, int row) const;
+
+    void commitDepth(size_t cell, float depth);
+
+private:
+    int mWidth = 0;                          // of the render target in pixels
+    int mHeight = 0;
+    int mSamples = 1;
+    int mColumns = 0;
+    int mRows = 0;
+    std::vector<float> mDepth;
+    std::vector<uint64_t> mCoverage;         // samples words per cell, partial coverage not committed yet
+    std::vector<float> mCoverageDepth;       // farthest depth of the triangles in mCoverage
+    std::vector<float3> mPositions;          // occluder vertices in canonical space
+    std::vector<uint8_t> mInFront;
+};
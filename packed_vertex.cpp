@@ -0,0 +1,225 @@
+#include "packed_vertex.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+float signNotZero(float value)
+{
+    return value < 0.0f ? -1.0f : 1.0f;
+}
+
+int16_t toSnorm16(float value)
+{
+    return (int16_t)lroundf(std::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// zero length normals encode as +z
+void encodeOctahedral(const float3& normal, int16_t& u, int16_t& v)
+{
+    const float l1 = std::fabs(normal.x()) + std::fabs(normal.y()) + std::fabs(normal.z());
+    if (l1 <= 0.0f)
+    {
+        u = 0;
+        v = 0;
+        return;
+    }
+    float x = normal.x() / l1;
+    float y = normal.y() / l1;
+    if (normal.z() < 0.0f)
+    {
+        // lower hemisphere folds over the diagonals of the square
+        const float foldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+        y = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = foldedX;
+    }
+    u = toSnorm16(x);
+    v = toSnorm16(y);
+}
+
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const int exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (exponent == 0xFF)
+    {
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+    const int halfExponent = exponent - 127 + 15;
+    if (halfExponent >= 31)
+    {
+        return sign | 0x7C00;
+    }
+    if (halfExponent <= 0)
+    {
+        // subnormal half, rounded to nearest even
+        if (halfExponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        const int shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+        {
+            half++;
+        }
+        return sign | half;
+    }
+    // a carry out of the mantissa moves into the exponent, up to infinity
+    uint32_t half = (halfExponent << 10) | (mantissa >> 13);
+    const uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+    {
+        half++;
+    }
+    return sign | half;
+}
+
+float halfToFloat(uint16_t value) {
+    const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        const float magnitude = std::ldexp((float)mantissa, -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 31)
+    {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+template <class T>
+T *PackedVertexBuffer::stream(size_t offset, size_t stride, int component) {
+    return reinterpret_cast<T*>(mData.data()->bytes + offset + component * stride);
+}
+
+template <class T>
+const T *PackedVertexBuffer::stream(size_t offset, size_t stride, int component) const {
+    return reinterpret_cast<const T*>(mData.data()->bytes + offset + component * stride);
+}
+
+PackedVertexBuffer::PackedVertexBuffer(const std::vector<Vertex> &vertices, bool halfPositions)
+        : mCount(vertices.size()), mHalfPositions(halfPositions) {
+    mPositionStride = alignUp(mCount * (halfPositions ? sizeof(uint16_t) : sizeof(float)), streamAlignment);
+    mAttributeStride = alignUp(mCount * sizeof(uint16_t), streamAlignment);
+    mPositionsOffset = 0;
+    mNormalsOffset = mPositionsOffset + 3 * mPositionStride;
+    mTextureCoordsOffset = mNormalsOffset + 2 * mAttributeStride;
+    mData.resize((mTextureCoordsOffset + 2 * mAttributeStride) / streamAlignment);
+
+    for (int c = 0; c < 2; c++)
+    {
+        float low = 0.0f;
+        float high = 0.0f;
+        if (!vertices.empty())
+        {
+            low = high = vertices[0].textureCoords[c];
+        }
+        for (const auto& vertex : vertices)
+        {
+            low = std::min(low, vertex.textureCoords[c]);
+            high = std::max(high, vertex.textureCoords[c]);
+        }
+        mTextureMin[c] = low;
+        mTextureScale[c] = (high - low) / 65535.0f;
+    }
+
+    for (size_t i = 0; i < mCount; i++)
+    {
+        const auto& vertex = vertices[i];
+        for (int c = 0; c < 3; c++)
+        {
+            if (halfPositions)
+            {
+                stream<uint16_t>(mPositionsOffset, mPositionStride, c)[i] = floatToHalf(vertex.position[c]);
+            }
+            else
+            {
+                stream<float>(mPositionsOffset, mPositionStride, c)[i] = vertex.position[c];
+            }
+        }
+        encodeOctahedral(vertex.normal, stream<int16_t>(mNormalsOffset, mAttributeStride, 0)[i], stream<int16_t>(mNormalsOffset, mAttributeStride, 1)[i]);
+        for (int c = 0; c < 2; c++)
+        {
+            const float normalized = mTextureScale[c] > 0.0f ? (vertex.textureCoords[c] - mTextureMin[c]) / mTextureScale[c] : 0.0f;
+            stream<uint16_t>(mTextureCoordsOffset, mAttributeStride, c)[i] = (uint16_t)lroundf(std::clamp(normalized, 0.0f, 65535.0f));
+        }
+    }
+}
+
+size_t PackedVertexBuffer::size() const {
+    return mCount;
+}
+
+float3 PackedVertexBuffer::getPosition(size_t index) const {
+    if (mHalfPositions)
+    {
+        return {halfToFloat(stream<uint16_t>(mPositionsOffset, mPositionStride, 0)[index]),
+                halfToFloat(stream<uint16_t>(mPositionsOffset, mPositionStride, 1)[index]),
+                halfToFloat(stream<uint16_t>(mPositionsOffset, mPositionStride, 2)[index])};
+    }
+    return {stream<float>(mPositionsOffset, mPositionStride, 0)[index],
+            stream<float>(mPositionsOffset, mPositionStride, 1)[index],
+            stream<float>(mPositionsOffset, mPositionStride, 2)[index]};
+}
+
+float3 PackedVertexBuffer::getNormal(size_t index) const {
+    const float3 direction = getNormalDirection(index);
+    // the octahedron never reaches the origin, the length is at least 1 / sqrt(3)
+    const float inverseLength = 1.0f / direction.length();
+    return {direction.x() * inverseLength, direction.y() * inverseLength, direction.z() * inverseLength};
+}
+
+float3 PackedVertexBuffer::getNormalDirection(size_t index) const {
+    float x = stream<int16_t>(mNormalsOffset, mAttributeStride, 0)[index] * (1.0f / 32767.0f);
+    float y = stream<int16_t>(mNormalsOffset, mAttributeStride, 1)[index] * (1.0f / 32767.0f);
+    const float z = 1.0f - std::fabs(x) - std::fabs(y);
+    if (z < 0.0f)
+    {
+        const float unfoldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+        y = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = unfoldedX;
+    }
+    return {x, y, z};
+}
+
+float3 PackedVertexBuffer::getTextureCoords(size_t index) const {
+    return {mTextureMin[0] + stream<uint16_t>(mTextureCoordsOffset, mAttributeStride, 0)[index] * mTextureScale[0],
+            mTextureMin[1] + stream<uint16_t>(mTextureCoordsOffset, mAttributeStride, 1)[index] * mTextureScale[1],
+            0.0f};
+}
+
+Vertex PackedVertexBuffer::getVertex(size_t index) const {
+    Vertex vertex;
+    vertex.position = getPosition(index);
+    vertex.normal = getNormal(index);
+    vertex.textureCoords = getTextureCoords(index);
+    return vertex;
+}
+
+size_t PackedVertexBuffer::sizeInBytes() const {
+    return mData.size() * sizeof(Block);
+}
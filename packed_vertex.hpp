@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vertex.hpp"
+
+/*
+ * storage of mesh vertices, Full keeps std::vector<Vertex>, the packed formats keep PackedVertexBuffer streams
+ */
+enum class VertexFormat
+{
+    Full,
+    Packed,                 // float positions, 32 bit octahedral normals, 16 bit texture coordinates
+    PackedHalfPosition,     // as Packed with half float positions
+};
+
+/*
+ * vertices as separate streams that each start at a 64 byte aligned offset:
+ * positions x[] y[] z[] as float or half, normals as two snorm16 octahedral coordinates and
+ * texture coordinates as two unorm16 over the range the mesh uses, decoded by the vertex stage,
+ * the third texture coordinate is dropped
+ */
+class PackedVertexBuffer {
+public:
+    PackedVertexBuffer() = default;
+
+    PackedVertexBuffer(const std::vector<Vertex>& vertices, bool halfPositions);
+
+    size_t size() const;
+
+    float3 getPosition(size_t index) const;
+
+    // unit length up to the encoding error
+    float3 getNormal(size_t index) const;
+
+    // the decoded normal before normalization, for callers that normalize after transforming it anyway
+    float3 getNormalDirection(size_t index) const;
+
+    float3 getTextureCoords(size_t index) const;
+
+    Vertex getVertex(size_t index) const;
+
+    size_t sizeInBytes() const;
+
+    static constexpr size_t streamAlignment = 64;
+
+private:
+    struct alignas(streamAlignment) Block
+    {
+        uint8_t bytes[streamAlignment];
+    };
+
+    template <class T>
+    T* stream(size_t offset, size_t stride, int component);
+
+    template <class T>
+    const T* stream(size_t offset, size_t stride, int component) const;
+
+private:
+    std::vector<Block> mData;
+    size_t mCount = 0;
+    bool mHalfPositions = false;
+    size_t mPositionStride = 0;      // bytes between the x[], y[] and z[] position arrays
+    size_t mAttributeStride = 0;     // bytes between the two arrays of the 16 bit streams
+    size_t mPositionsOffset = 0;
+    size_t mNormalsOffset = 0;
+    size_t mTextureCoordsOffset = 0;
+    float mTextureMin[2] = {0.0f, 0.0f};
+    float mTextureScale[2] = {0.0f, 0.0f};     // unorm16 step, zero for a constant coordinate
+};
+
+uint16_t floatToHalf(float value);
+
+float halfToFloat(uint16_t value);
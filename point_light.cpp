@@ -1,9 +1,14 @@
 #include "point_light.hpp"
 #include <algorithm>
+#include <cmath>
 
 float3 PointLight::calculate(const Fragment &fragment, VertexProcessor &vertexProcessor,std::shared_ptr<BMP> texture) const {
     auto L = mPosition - fragment.position;
-    L.normalize();
+    if (mQuality == LightingQuality::Exact)
+    {
+        // the fast path normalizes in doCalculate anyway
+        L.normalizeUnchecked();
+    }
     return doCalculate(L, fragment, vertexProcessor, texture);
 }
 
@@ -11,4 +16,15 @@ PointLight::PointLight(const float3 &position, const float3 &ambient, const floa
                                    const float3 &specular, float shininess) : Light(position, ambient, diffuse,
                                                                                     specular, shininess) {
 
-}
\ No newline at end of file
+}
+
+void PointLight::setupShadowProjection(VertexProcessor &lightProcessor, const float3 &center, float radius) const {
+    // perspective frustum from the light around the bounding sphere of the casters
+    const float distance = (center - mPosition).length();
+    const float halfAngle = distance > radius ? asinf(radius / distance) : 85.0f * M_PIf32 / 180.0f;
+    const float near = std::max(distance - radius, 0.01f);
+    lightProcessor.setPerspective(std::min(2.0f * halfAngle * 180.0f / M_PIf32, 170.0f), 1.0f, near, distance + radius);
+    const float3 direction = center - mPosition;
+    const float3 up = std::fabs(direction.y()) > 0.99f * distance ? float3{1.0f, 0.0f, 0.0f} : float3{0.0f, 1.0f, 0.0f};
+    lightProcessor.setLookAt(mPosition, center, up);
+}
@@ -1,24 +1,679 @@
 #include "rasterizer.hpp"
-#include "BMP.h"
+#include <algorithm>
+#include "render_stats.hpp"
 
-Rasterizer::Rasterizer(BMP &buffer) : mBuffer(buffer) {
+namespace {
+
+// sample positions in 1/16 pixel around the pixel position, rotated grid for 4 and the standard 8 pattern
+const int samplePattern4[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+const int samplePattern8[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+
+const int (*samplePattern(int samples))[2] {
+    return samples == 8 ? samplePattern8 : samplePattern4;
+}
+
+// curved or creased triangles keep full rate under adaptive shading, specular highlights change fast across them
+bool isCurved(const float3& normal1, const float3& normal2, const float3& normal3) {
+    const float minCos = 0.98f;
+    return normal1.dotProduct(normal2) < minCos * normal1.length() * normal2.length()
+           || normal2.dotProduct(normal3) < minCos * normal2.length() * normal3.length()
+           || normal3.dotProduct(normal1) < minCos * normal3.length() * normal1.length();
+}
+
+}
+
+Rasterizer::Rasterizer(RenderTarget &target, VertexProcessor &vertexProcessor) : mTarget(target), mVertexProcessor(vertexProcessor), mScissor(target.getRect()) {
 
 }
 
-void Rasterizer::drawTriangle(float x1, float y1, float z1, const float3& normal1, float x2, float y2, float z2, const float3& normal2, float x3, float y3, float z3, const float3& normal3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3) {
-    mBuffer.fill_triangle(toPixelX(x1), toPixelY(y1), z1, normal1, toPixelX(x2), toPixelY(y2), z2, normal2, toPixelX(x3), toPixelY(y3), z3, normal3, light, positions, f1, f2, f3);
+void Rasterizer::drawTriangle(float x1, float y1, float z1, const float3& normal1, float x2, float y2, float z2, const float3& normal2, float x3, float y3, float z3, const float3& normal3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3, const float3& inverseW) {
+    RENDER_STATS_SCOPE(RenderStage::Setup);
+    fillTriangle(toPixelX(x1), toPixelY(y1), z1, normal1, toPixelX(x2), toPixelY(y2), z2, normal2, toPixelX(x3), toPixelY(y3), z3, normal3, light, positions, f1, f2, f3, inverseW);
 }
 
 void Rasterizer::drawTriangleVertex(float x1, float y1, float z1, const float3& vertexColors1, float x2, float y2, float z2, const float3& vertexColors2, float x3, float y3, float z3, const float3& vertexColors3) {
-    mBuffer.fill_triangle_vertex(toPixelX(x1), toPixelY(y1), z1, vertexColors1, toPixelX(x2), toPixelY(y2), z2, vertexColors2, toPixelX(x3), toPixelY(y3), z3, vertexColors3);
+    fillTriangleVertex(toPixelX(x1), toPixelY(y1), z1, vertexColors1, toPixelX(x2), toPixelY(y2), z2, vertexColors2, toPixelX(x3), toPixelY(y3), z3, vertexColors3);
+}
+
+void Rasterizer::drawTriangleDepth(float x1, float y1, float z1, float x2, float y2, float z2, float x3, float y3, float z3) {
+    RENDER_STATS_SCOPE(RenderStage::Setup);
+    fillTriangleDepth(toPixelX(x1), toPixelY(y1), z1, toPixelX(x2), toPixelY(y2), z2, toPixelX(x3), toPixelY(y3), z3);
+}
+
+void Rasterizer::bindTexture(std::shared_ptr<BMP> texture) {
+    mTexture = std::move(texture);
 }
 
+bool Rasterizer::isOccluded(const ScreenBounds &bounds) const {
+    if (mDepthTest == DepthTest::Equal)
+    {
+        // after a prepass the buffer already holds the geometry being tested
+        return false;
+    }
+    const PixelRect rect = getPixelBounds(bounds);
+    if (rect.isEmpty())
+    {
+        return false;
+    }
+    for (int s = 0; s < mTarget.getSamples(); s++)
+    {
+        for (int y = rect.minY; y <= rect.maxY; ++y) {
+            for (int x = rect.minX; x <= rect.maxX; ++x) {
+                if (mTarget.sampleDepth(x, y, s) > bounds.minDepth)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool Rasterizer::prepareTriangle(const float3 &p1, const float3 &p2, const float3 &p3, const Vertex &f1, const Vertex &f2, const Vertex &f3, const float3 &inverseW, PreparedTriangle &prepared) const {
+    // clipped to the target only, the scissor at draw time narrows the bounds further
+    if (!setupTriangle(toPixelX(p1.x()), toPixelY(p1.y()), toPixelX(p2.x()), toPixelY(p2.y()), toPixelX(p3.x()), toPixelY(p3.y()), mTarget.getRect(), prepared.setup))
+    {
+        return false;
+    }
+    prepared.planes = AttributePlanes(f1, f2, f3, inverseW);
+    prepared.positions[0] = p1;
+    prepared.positions[1] = p2;
+    prepared.positions[2] = p3;
+    // small triangles are always shaded at full rate
+    prepared.curved = !prepared.setup.small && isCurved(f1.normal, f2.normal, f3.normal);
+    return true;
+}
+
+void Rasterizer::drawPrepared(const PreparedTriangle &prepared, const Light &light) {
+    RENDER_STATS_SCOPE(RenderStage::Raster);
+    const auto& p = prepared.positions;
+    if (mTarget.getSamples() > 1)
+    {
+        const TriangleSetup& s = prepared.setup;
+        Fragment fragment;
+        fillTriangleMultisample(s.x1, s.y1, p[0].z(), s.x2, s.y2, p[1].z(), s.x3, s.y3, p[2].z(), true, [&](const PendingPixel& pixel) {
+            mTarget.setSamples(pixel.x, pixel.y, pixel.samples, shadeFragment(prepared.planes, p, light, pixel.lambda1, pixel.lambda2, 1 - pixel.lambda1 - pixel.lambda2, fragment));
+        });
+        return;
+    }
+    TriangleSetup setup;
+    if (clipToScissor(prepared.setup, setup))
+    {
+        fillTriangleShaded(setup, prepared.planes, p, prepared.curved, light);
+    }
+}
+
+void Rasterizer::drawPreparedDepth(const PreparedTriangle &prepared) {
+    RENDER_STATS_SCOPE(RenderStage::Raster);
+    const auto& p = prepared.positions;
+    if (mTarget.getSamples() > 1)
+    {
+        const TriangleSetup& s = prepared.setup;
+        fillTriangleMultisample(s.x1, s.y1, p[0].z(), s.x2, s.y2, p[1].z(), s.x3, s.y3, p[2].z(), false, [](const PendingPixel&) {});
+        return;
+    }
+    TriangleSetup setup;
+    if (clipToScissor(prepared.setup, setup))
+    {
+        fillDepth(setup, p[0].z(), p[1].z(), p[2].z());
+    }
+}
+
+PixelRect Rasterizer::getPixelBounds(const ScreenBounds &bounds) const {
+    // one extra pixel around covers truncation in toPixelX and toPixelY
+    return PixelRect{std::max(toPixelX(bounds.minX) - 1, 0), std::max(toPixelY(bounds.maxY) - 1, 0),
+                     std::min(toPixelX(bounds.maxX) + 1, mTarget.getWidth() - 1), std::min(toPixelY(bounds.minY) + 1, mTarget.getHeight() - 1)};
+}
+
+void Rasterizer::setScissor(const PixelRect &rect) {
+    const PixelRect target = mTarget.getRect();
+    mScissor = PixelRect{std::max(rect.minX, target.minX), std::max(rect.minY, target.minY), std::min(rect.maxX, target.maxX), std::min(rect.maxY, target.maxY)};
+    mScissored = true;
+}
+
+void Rasterizer::resetScissor() {
+    mScissor = mTarget.getRect();
+    mScissored = false;
+}
+
+bool Rasterizer::hasScissor() const {
+    return mScissored;
+}
+
+const PixelRect &Rasterizer::getScissor() const {
+    return mScissor;
+}
+
+void Rasterizer::setDepthTest(DepthTest depthTest) {
+    mDepthTest = depthTest;
+}
+
+void Rasterizer::setShadingRate(ShadingRate shadingRate) {
+    mShadingRate = shadingRate;
+}
+
+size_t Rasterizer::getShadedFragments() const {
+    return mShadedFragments;
+}
+
+int Rasterizer::getWidth() const {
+    return mTarget.getWidth();
+}
+
+int Rasterizer::getHeight() const {
+    return mTarget.getHeight();
+}
+
+int Rasterizer::getSamples() const {
+    return mTarget.getSamples();
+}
+
+void Rasterizer::getSampleOffset(int samples, int index, int &x, int &y) {
+    if (samples == 1)
+    {
+        x = 0;
+        y = 0;
+        return;
+    }
+    x = samplePattern(samples)[index][0];
+    y = samplePattern(samples)[index][1];
+}
 
 int Rasterizer::toPixelX(float x) const {
-    return (x+1)*mBuffer.bmp_info_header.width *0.5f;
+    return (x+1)*mTarget.getWidth() *0.5f;
 }
 
 int Rasterizer::toPixelY(float y) const {
-    // BMP format requires reverting y axis
-    return mBuffer.bmp_info_header.height - ((y+1)*mBuffer.bmp_info_header.height *0.5f);
+    // render target rows go from the top down
+    return mTarget.getHeight() - ((y+1)*mTarget.getHeight() *0.5f);
+}
+
+void Rasterizer::fillTriangle(int x1, int y1, float z1, const float3& normal1, int x2, int y2, float z2, const float3& normal2, int x3, int y3, float z3, const float3& normal3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3, const float3& inverseW) {
+    RENDER_STATS_SCOPE(RenderStage::Raster);
+
+    // the normals passed separately are the ones the planes are built from
+    Vertex v1;
+    Vertex v2;
+    Vertex v3;
+    v1.normal = normal1;
+    v2.normal = normal2;
+    v3.normal = normal3;
+    v1.textureCoords = f1.textureCoords;
+    v2.textureCoords = f2.textureCoords;
+    v3.textureCoords = f3.textureCoords;
+    const AttributePlanes planes(v1, v2, v3, inverseW);
+    Fragment fragment;
+    if (mTarget.getSamples() > 1)
+    {
+        fillTriangleMultisample(x1, y1, z1, x2, y2, z2, x3, y3, z3, true, [&](const PendingPixel& pixel) {
+            mTarget.setSamples(pixel.x, pixel.y, pixel.samples, shadeFragment(planes, positions.data(), light, pixel.lambda1, pixel.lambda2, 1 - pixel.lambda1 - pixel.lambda2, fragment));
+        });
+        return;
+    }
+
+    TriangleSetup setup;
+    if (!setupTriangle(x1, y1, x2, y2, x3, y3, mScissor, setup))
+    {
+        return;
+    }
+    // the normal test only matters to adaptive rates, skip it for the others
+    const bool curved = mShadingRate == ShadingRate::Adaptive && !setup.small && isCurved(normal1, normal2, normal3);
+    fillTriangleShaded(setup, planes, positions.data(), curved, light);
+}
+
+void Rasterizer::fillTriangleShaded(const TriangleSetup &setup, const AttributePlanes &planes, const float3 *positions, bool curved, const Light &light) {
+    const PixelRect& bounds = setup.bounds;
+    mTarget.resolveRegion(bounds.minX, bounds.minY, bounds.maxX, bounds.maxY);
+
+    Fragment fragment;
+    const auto shade = [&](float lambda1, float lambda2, float lambda3) {
+        return shadeFragment(planes, positions, light, lambda1, lambda2, lambda3, fragment);
+    };
+    const float z1 = positions[0].z();
+    const float z2 = positions[1].z();
+    const float z3 = positions[2].z();
+    const int rate = setup.small ? 1 : selectShadingRate(-setup.area * 0.5f, curved);
+    if (rate > 1)
+    {
+        fillTriangleCoarse(setup, rate, z1, z2, z3, shade);
+        return;
+    }
+    fillPixels(setup, z1, z2, z3, [&](const PendingPixel& pixel) {
+        mTarget.setPixel(pixel.x, pixel.y, shade(pixel.lambda1, pixel.lambda2, 1 - pixel.lambda1 - pixel.lambda2));
+    });
+}
+
+float3 Rasterizer::shadeFragment(const AttributePlanes &planes, const float3 *positions, const Light &light, float lambda1, float lambda2, float lambda3, Fragment &fragment) {
+    mShadedFragments++;
+    planes.interpolate(lambda1, lambda2, fragment);
+    fragment.normal.normalizeUnchecked();
+    // canonical positions are already projected, they are linear on screen
+    for (int i = 0; i < 3; i++)
+    {
+        fragment.position[i] = positions[0][i] * lambda1 + positions[1][i] * lambda2 + positions[2][i] * lambda3;
+    }
+    return light.calculate(fragment, mVertexProcessor, mTexture);
+}
+
+template <class Shade>
+void Rasterizer::fillTriangleCoarse(const TriangleSetup &setup, int rate, float z1, float z2, float z3, Shade &&shade) {
+    // lattice points are shaded on first use with barycentrics clamped to the triangle so colors never
+    // come from outside it, pixels interpolate the four surrounding points
+    const PixelRect& bounds = setup.bounds;
+    const int latticeX = bounds.minX / rate;
+    const int latticeY = bounds.minY / rate;
+    const int latticeWidth = bounds.maxX / rate - latticeX + 2;
+    const float inverseRate = 1.0f / rate;
+    const size_t points = latticeWidth * (bounds.maxY / rate - latticeY + 2);
+    if (points > mCoarseStamps.size())
+    {
+        mCoarseStamps.resize(points, 0);
+        mCoarseColors.resize(points);
+    }
+    if (++mCoarseStamp == 0)
+    {
+        std::fill(mCoarseStamps.begin(), mCoarseStamps.end(), 0);
+        mCoarseStamp = 1;
+    }
+    const auto latticeColor = [&](int lx, int ly) -> const float3& {
+        const int index = (ly - latticeY) * latticeWidth + lx - latticeX;
+        if (mCoarseStamps[index] != mCoarseStamp)
+        {
+            float lambda1 = 0.0f;
+            float lambda2 = 0.0f;
+            setup.barycentrics(lx * rate, ly * rate, lambda1, lambda2);
+            lambda1 = std::max(lambda1, 0.0f);
+            lambda2 = std::max(lambda2, 0.0f);
+            const float lambda3 = std::max(1 - lambda1 - lambda2, 0.0f);
+            const float sum = lambda1 + lambda2 + lambda3;
+            mCoarseColors[index] = shade(lambda1 / sum, lambda2 / sum, lambda3 / sum);
+            mCoarseStamps[index] = mCoarseStamp;
+        }
+        return mCoarseColors[index];
+    };
+    fillPixels(setup, z1, z2, z3, [&](const PendingPixel& pixel) {
+        const int lx = pixel.x / rate;
+        const int ly = pixel.y / rate;
+        const float fx = (pixel.x - lx * rate) * inverseRate;
+        const float fy = (pixel.y - ly * rate) * inverseRate;
+        const float3& c00 = latticeColor(lx, ly);
+        const float3& c10 = latticeColor(lx + 1, ly);
+        const float3& c01 = latticeColor(lx, ly + 1);
+        const float3& c11 = latticeColor(lx + 1, ly + 1);
+        // bilinear weights in plain floats, the float3 operators would build six temporaries per pixel
+        const float w00 = (1 - fx) * (1 - fy);
+        const float w10 = fx * (1 - fy);
+        const float w01 = (1 - fx) * fy;
+        const float w11 = fx * fy;
+        float3 color;
+        for (int i = 0; i < 3; i++)
+        {
+            color[i] = c00[i] * w00 + c10[i] * w10 + c01[i] * w01 + c11[i] * w11;
+        }
+        mTarget.setPixel(pixel.x, pixel.y, color);
+    });
+}
+
+template <class Write>
+void Rasterizer::fillPixels(const TriangleSetup &setup, float z1, float z2, float z3, Write &&write) {
+    size_t passed = 0;
+    forEachCoveredPixel(setup, [&](int x, int y, float lambda1, float lambda2) {
+        const float lambda3 = 1 - lambda1 - lambda2;
+        const float depth = lambda1 * z1 + lambda2 * z2 + lambda3 * z3;
+        if (!passesDepthTest(depth, mTarget.depth(x, y)))
+        {
+            return;
+        }
+        passed++;
+        mTarget.depth(x, y) = depth;
+        addPending({x, y, lambda1, lambda2, 1u}, write);
+    });
+    shadePending(write);
+    RENDER_STATS_COUNT(pixelsPassed, passed);
+}
+
+void Rasterizer::fillTriangleDepth(int x1, int y1, float z1, int x2, int y2, float z2, int x3, int y3, float z3) {
+    RENDER_STATS_SCOPE(RenderStage::Raster);
+
+    if (mTarget.getSamples() > 1)
+    {
+        fillTriangleMultisample(x1, y1, z1, x2, y2, z2, x3, y3, z3, false, [](const PendingPixel&) {});
+        return;
+    }
+
+    TriangleSetup setup;
+    if (!setupTriangle(x1, y1, x2, y2, x3, y3, mScissor, setup))
+    {
+        return;
+    }
+    fillDepth(setup, z1, z2, z3);
+}
+
+void Rasterizer::fillDepth(const TriangleSetup &setup, float z1, float z2, float z3) {
+    size_t passed = 0;
+    forEachCoveredPixel(setup, [&](int x, int y, float lambda1, float lambda2) {
+        // same expressions as fillTriangle so both passes produce identical depths
+        const float lambda3 = 1 - lambda1 - lambda2;
+        const float depth = lambda1 * z1 + lambda2 * z2 + lambda3 * z3;
+        if (depth < mTarget.depth(x, y))
+        {
+            passed++;
+            mTarget.depth(x, y) = depth;
+        }
+    });
+    RENDER_STATS_COUNT(pixelsPassed, passed);
+}
+
+void Rasterizer::fillTriangleVertex(int x1, int y1, float z1, const float3& vertexColor1, int x2, int y2, float z2, const float3& vertexColor2, int x3, int y3, float z3, const float3& vertexColor3) {
+
+    if (mTarget.getSamples() > 1)
+    {
+        fillTriangleMultisample(x1, y1, z1, x2, y2, z2, x3, y3, z3, true, [&](const PendingPixel& pixel) {
+            const float lambda3 = 1 - pixel.lambda1 - pixel.lambda2;
+            mTarget.setSamples(pixel.x, pixel.y, pixel.samples, vertexColor1 * pixel.lambda1 + vertexColor2 * pixel.lambda2 + vertexColor3 * lambda3);
+        });
+        return;
+    }
+
+    TriangleSetup setup;
+    if (!setupTriangle(x1, y1, x2, y2, x3, y3, mScissor, setup))
+    {
+        return;
+    }
+    mTarget.resolveRegion(setup.bounds.minX, setup.bounds.minY, setup.bounds.maxX, setup.bounds.maxY);
+    forEachCoveredPixel(setup, [&](int x, int y, float lambda1, float lambda2) {
+        const float lambda3 = 1 - lambda1 - lambda2;
+        const float depth = lambda1 * z1 + lambda2 * z2 + lambda3 * z3;
+        if (passesDepthTest(depth, mTarget.depth(x, y)))
+        {
+            mTarget.depth(x, y) = depth;
+            mTarget.setPixel(x, y, vertexColor1 * lambda1 + vertexColor2 * lambda2 + vertexColor3 * lambda3);
+        }
+    });
+}
+
+Rasterizer::AttributePlanes::AttributePlanes(const Vertex &f1, const Vertex &f2, const Vertex &f3, const float3 &inverseW) {
+    const Vertex* vertices[3] = {&f1, &f2, &f3};
+    float values[3][count];
+    for (int v = 0; v < 3; v++)
+    {
+        const float w = inverseW[v];
+        values[v][0] = w;
+        for (int i = 0; i < 3; i++)
+        {
+            values[v][1 + i] = vertices[v]->normal[i] * w;
+            values[v][4 + i] = vertices[v]->textureCoords[i] * w;
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        base[i] = values[2][i];
+        step1[i] = values[0][i] - values[2][i];
+        step2[i] = values[1][i] - values[2][i];
+    }
+}
+
+void Rasterizer::AttributePlanes::interpolate(float lambda1, float lambda2, Fragment &fragment) const {
+    float values[count];
+    for (int i = 0; i < count; i++)
+    {
+        values[i] = base[i] + lambda1 * step1[i] + lambda2 * step2[i];
+    }
+    const float w = 1.0f / values[0];
+    for (int i = 0; i < 3; i++)
+    {
+        fragment.normal[i] = values[1 + i] * w;
+        fragment.textureCoords[i] = values[4 + i] * w;
+    }
+}
+
+bool Rasterizer::setupTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const PixelRect &clip, TriangleSetup &setup) const {
+    setup.bounds = PixelRect{std::max(std::min(std::min(x1, x2), x3), clip.minX), std::max(std::min(std::min(y1, y2), y3), clip.minY),
+                             std::min(std::max(std::max(x1, x2), x3), clip.maxX), std::min(std::max(std::max(y1, y2), y3), clip.maxY)};
+    setup.x1 = x1;
+    setup.y1 = y1;
+    setup.x2 = x2;
+    setup.y2 = y2;
+    setup.x3 = x3;
+    setup.y3 = y3;
+    setup.dx12 = x1 - x2;
+    setup.dx23 = x2 - x3;
+    setup.dx31 = x3 - x1;
+    setup.dy12 = y1 - y2;
+    setup.dy23 = y2 - y3;
+    setup.dy31 = y3 - y1;
+    setup.area = setup.dy23 * (x1 - x3) - setup.dx23 * (y1 - y3);
+    // every edge function is non negative only inside clockwise triangles, which have a negative area here,
+    // zero area and the other winding cover nothing
+    if (setup.area >= 0 || setup.bounds.isEmpty())
+    {
+        RENDER_STATS_COUNT(trianglesRejected, 1);
+        return false;
+    }
+    setup.inverseArea = 1.0f / setup.area;
+    // top-left rule, pixels on an edge belong to it only for top and left edges
+    setup.bias1 = setup.dy12 < 0 || (setup.dy12 == 0 && setup.dx12 > 0) ? 0 : -1;
+    setup.bias2 = setup.dy23 < 0 || (setup.dy23 == 0 && setup.dx23 > 0) ? 0 : -1;
+    setup.bias3 = setup.dy31 < 0 || (setup.dy31 == 0 && setup.dx31 > 0) ? 0 : -1;
+    setup.small = (setup.bounds.maxX - setup.bounds.minX + 1) * (setup.bounds.maxY - setup.bounds.minY + 1) <= 4;
+    RENDER_STATS_COUNT(trianglesSmall, setup.small);
+    return true;
+}
+
+bool Rasterizer::clipToScissor(const TriangleSetup &prepared, TriangleSetup &setup) const {
+    setup = prepared;
+    if (!mScissored)
+    {
+        return true;
+    }
+    PixelRect& bounds = setup.bounds;
+    bounds = PixelRect{std::max(bounds.minX, mScissor.minX), std::max(bounds.minY, mScissor.minY), std::min(bounds.maxX, mScissor.maxX), std::min(bounds.maxY, mScissor.maxY)};
+    if (bounds.isEmpty())
+    {
+        RENDER_STATS_COUNT(trianglesRejected, 1);
+        return false;
+    }
+    setup.small = (bounds.maxX - bounds.minX + 1) * (bounds.maxY - bounds.minY + 1) <= 4;
+    return true;
+}
+
+template <class Visit>
+void Rasterizer::forEachCoveredPixel(const TriangleSetup &setup, Visit &&visit) const {
+    const PixelRect& bounds = setup.bounds;
+    size_t tested = 0;
+    if (setup.small)
+    {
+        // at most four candidates, the edge functions are evaluated directly
+        for (int y = bounds.minY; y <= bounds.maxY; ++y) {
+            for (int x = bounds.minX; x <= bounds.maxX; ++x) {
+                const int edge1 = setup.dx12 * (y - setup.y1) - setup.dy12 * (x - setup.x1);
+                const int edge2 = setup.dx23 * (y - setup.y2) - setup.dy23 * (x - setup.x2);
+                const int edge3 = setup.dx31 * (y - setup.y3) - setup.dy31 * (x - setup.x3);
+                if (((edge1 + setup.bias1) | (edge2 + setup.bias2) | (edge3 + setup.bias3)) >= 0)
+                {
+                    tested++;
+                    visit(x, y, -edge2 * setup.inverseArea, -edge3 * setup.inverseArea);
+                }
+            }
+        }
+    }
+    else
+    {
+        // edge functions step by a constant per pixel and per row
+        int row1 = setup.dx12 * (bounds.minY - setup.y1) - setup.dy12 * (bounds.minX - setup.x1);
+        int row2 = setup.dx23 * (bounds.minY - setup.y2) - setup.dy23 * (bounds.minX - setup.x2);
+        int row3 = setup.dx31 * (bounds.minY - setup.y3) - setup.dy31 * (bounds.minX - setup.x3);
+        for (int y = bounds.minY; y <= bounds.maxY; ++y) {
+            int edge1 = row1;
+            int edge2 = row2;
+            int edge3 = row3;
+            for (int x = bounds.minX; x <= bounds.maxX; ++x) {
+                if (((edge1 + setup.bias1) | (edge2 + setup.bias2) | (edge3 + setup.bias3)) >= 0)
+                {
+                    tested++;
+                    visit(x, y, -edge2 * setup.inverseArea, -edge3 * setup.inverseArea);
+                }
+                edge1 -= setup.dy12;
+                edge2 -= setup.dy23;
+                edge3 -= setup.dy31;
+            }
+            row1 += setup.dx12;
+            row2 += setup.dx23;
+            row3 += setup.dx31;
+        }
+    }
+    RENDER_STATS_COUNT(pixelsTested, tested);
+    RENDER_STATS_COUNT(trianglesRasterized, tested > 0);
+}
+
+template <class Write>
+void Rasterizer::fillTriangleMultisample(int x1, int y1, float z1, int x2, int y2, float z2, int x3, int y3, float z3, bool shaded, Write&& write) {
+    // samples stay within half a pixel, so the single sample bounding box covers them
+    const int minx = std::max(std::min(std::min(x1, x2), x3), mScissor.minX);
+    const int maxx = std::min(std::max(std::max(x1, x2), x3), mScissor.maxX);
+    const int miny = std::max(std::min(std::min(y1, y2), y3), mScissor.minY);
+    const int maxy = std::min(std::max(std::max(y1, y2), y3), mScissor.maxY);
+    if (shaded)
+    {
+        mTarget.resolveRegion(minx, miny, maxx, maxy);
+    }
+
+    // edge functions on the sample grid, same top-left rule as the single sample path
+    const int64_t dx12 = x1 - x2;
+    const int64_t dx23 = x2 - x3;
+    const int64_t dx31 = x3 - x1;
+    const int64_t dy12 = y1 - y2;
+    const int64_t dy23 = y2 - y3;
+    const int64_t dy31 = y3 - y1;
+
+    const bool tl1 = dy12 < 0 || (dy12 == 0 && dx12 > 0);
+    const bool tl2 = dy23 < 0 || (dy23 == 0 && dx23 > 0);
+    const bool tl3 = dy31 < 0 || (dy31 == 0 && dx31 > 0);
+
+    const float area1 = (float)(dy23 * (x1 - x3) - dx23 * (y1 - y3)) * sampleScale;
+    const float area2 = (float)(dy31 * dx23 + (x1 - x3) * dy23) * sampleScale;
+    if (area1 == 0.0f || area2 == 0.0f)
+    {
+        return;
+    }
+
+    const int samples = mTarget.getSamples();
+    const int (*pattern)[2] = samplePattern(samples);
+    size_t tested = 0;
+    size_t passedPixels = 0;
+    for (int y = miny; y <= maxy; ++y) {
+        for (int x = minx; x <= maxx; ++x) {
+            unsigned covered = 0;
+            unsigned passed = 0;
+            float lambdas[2] = {0.0f, 0.0f};
+            for (int s = 0; s < samples; s++)
+            {
+                const int64_t sx = (int64_t)x * sampleScale + pattern[s][0];
+                const int64_t sy = (int64_t)y * sampleScale + pattern[s][1];
+                const int64_t cond1 = dx12 * (sy - y1 * sampleScale) - dy12 * (sx - x1 * sampleScale);
+                const int64_t cond2 = dx23 * (sy - y2 * sampleScale) - dy23 * (sx - x2 * sampleScale);
+                const int64_t cond3 = dx31 * (sy - y3 * sampleScale) - dy31 * (sx - x3 * sampleScale);
+                if (!((cond1 >= 0 && tl1 || cond1 > 0 && !tl1) &&
+                      (cond2 >= 0 && tl2 || cond2 > 0 && !tl2) &&
+                      (cond3 >= 0 && tl3 || cond3 > 0 && !tl3)))
+                {
+                    continue;
+                }
+                const float lambda1 = (float)(dy23 * (sx - x3 * sampleScale) - dx23 * (sy - y3 * sampleScale)) / area1;
+                const float lambda2 = (float)(dy31 * (sx - x3 * sampleScale) + (x1 - x3) * (sy - y3 * sampleScale)) / area2;
+                const float depth = lambda1 * z1 + lambda2 * z2 + (1 - lambda1 - lambda2) * z3;
+                if (covered == 0)
+                {
+                    // the shading position must not depend on depth, a prepass would change it otherwise
+                    lambdas[0] = lambda1;
+                    lambdas[1] = lambda2;
+                }
+                covered |= 1u << s;
+                float& stored = mTarget.sampleDepth(x, y, s);
+                if (shaded ? passesDepthTest(depth, stored) : depth < stored)
+                {
+                    stored = depth;
+                    passed |= 1u << s;
+                }
+            }
+            tested += covered != 0;
+            if (passed == 0)
+            {
+                continue;
+            }
+            passedPixels++;
+            if (shaded)
+            {
+                // interior pixels shade at the pixel position like the single sample path, edge pixels at the first covered sample
+                if (covered == (1u << samples) - 1)
+                {
+                    lambdas[0] = (float)(dy23 * (x - x3) - dx23 * (y - y3)) * sampleScale / area1;
+                    lambdas[1] = (float)(dy31 * (x - x3) + (x1 - x3) * (y - y3)) * sampleScale / area2;
+                }
+                addPending({x, y, lambdas[0], lambdas[1], passed}, write);
+            }
+        }
+    }
+    shadePending(write);
+    RENDER_STATS_COUNT(pixelsPassed, passedPixels);
+    RENDER_STATS_COUNT(pixelsTested, tested);
+    RENDER_STATS_COUNT(trianglesRasterized, tested > 0);
+}
+
+template <class Write>
+void Rasterizer::addPending(const PendingPixel &pixel, Write &&write) {
+    mPending.push_back(pixel);
+    if (mPending.size() == shadeBatch)
+    {
+        shadePending(write);
+    }
+}
+
+template <class Write>
+void Rasterizer::shadePending(Write &&write) {
+    if (mPending.empty())
+    {
+        return;
+    }
+    RENDER_STATS_SCOPE(RenderStage::Shade);
+    const size_t shadedBefore = mShadedFragments;
+    for (const auto& pixel : mPending)
+    {
+        write(pixel);
+    }
+    RENDER_STATS_COUNT(pixelsShaded, mShadedFragments - shadedBefore);
+    RENDER_STATS_COUNT(textureFetches, mTexture ? mShadedFragments - shadedBefore : 0);
+    mPending.clear();
+}
+
+int Rasterizer::selectShadingRate(float area, bool curved) const {
+    int rate = 1;
+    switch (mShadingRate)
+    {
+        case ShadingRate::Rate1x1:
+            return 1;
+        case ShadingRate::Rate2x2:
+            rate = 2;
+            break;
+        case ShadingRate::Rate4x4:
+        case ShadingRate::Adaptive:
+            rate = 4;
+            break;
+    }
+    if (mShadingRate == ShadingRate::Adaptive && curved)
+    {
+        return 1;
+    }
+    // below 16 lattice cells the lattice points along the edges and the interpolation cost more than
+    // the shading they save
+    while (rate > 1 && area < 16.0f * rate * rate)
+    {
+        rate /= 2;
+    }
+    return rate;
+}
+
+bool Rasterizer::passesDepthTest(float depth, float stored) const {
+    // exact compare is safe, the prepass computes depth with the same expressions as fillTriangle
+    return mDepthTest == DepthTest::Equal ? depth == stored : depth < stored;
 }
@@ -1,26 +1,255 @@
 #pragma once
 
 #include "BMP.h"
+#include "render_target.hpp"
 #include "vertex.hpp"
 #include "vector.hpp"
 #include "light.hpp"
 
+enum class DepthTest {
+    Less,                                    // regular z-buffering
+    Equal                                    // shading pass after a depth prepass
+};
+
+/*
+ * how often Light::calculate runs inside a triangle, coarse rates shade a lattice every 2 or 4 pixels and
+ * interpolate it, depth and coverage stay per pixel
+ */
+enum class ShadingRate {
+    Rate1x1,
+    Rate2x2,
+    Rate4x4,
+    Adaptive                                 // 4x4 down to 1x1 per triangle from its size and normal variation
+};
+
 class Rasterizer {
 public:
-    explicit Rasterizer(BMP& buffer);
+    Rasterizer(RenderTarget& target, VertexProcessor& vertexProcessor);
+
+    /*
+     * draw triangle clockwise using canonical space, inverseW holds 1 / w of the clip coordinates of the vertices,
+     * normals and texture coordinates are interpolated perspective correct with it
+     */
+    void drawTriangle(float x1, float y1, float z1, const float3& vertexColors1, float x2, float y2, float z2, const float3& vertexColors2, float x3, float y3, float z3, const float3& vertexColors3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3, const float3& inverseW = float3{1.0f, 1.0f, 1.0f});
 
     /*
-     * draw triangle clockwise using canonical space
+     * depth only triangle, no attributes or shading
      */
-    void drawTriangle(float x1, float y1, float z1, const float3& vertexColors1, float x2, float y2, float z2, const float3& vertexColors2, float x3, float y3, float z3, const float3& vertexColors3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3);
+    void drawTriangleDepth(float x1, float y1, float z1, float x2, float y2, float z2, float x3, float y3, float z3);
+
+    void bindTexture(std::shared_ptr<BMP> texture);
 
     void drawTriangleVertex(float x1, float y1, float z1, const float3& vertexColors1, float x2, float y2, float z2, const float3& vertexColors2, float x3, float y3, float z3, const float3& vertexColors3);
 
+    /*
+     * true when every pixel under the bounds already holds a nearer depth
+     */
+    bool isOccluded(const ScreenBounds& bounds) const;
+
+    /*
+     * pixels that may be covered by geometry inside the canonical bounds, clamped to the target
+     */
+    PixelRect getPixelBounds(const ScreenBounds& bounds) const;
+
+    /*
+     * restricts every following draw to the rectangle until resetScissor
+     */
+    void setScissor(const PixelRect& rect);
+
+    void resetScissor();
+
+    bool hasScissor() const;
+
+    const PixelRect& getScissor() const;
+
+    void setDepthTest(DepthTest depthTest);
+
+    /*
+     * applies to single sample targets, triangles too small to profit are shaded at a finer rate
+     */
+    void setShadingRate(ShadingRate shadingRate);
+
+    /*
+     * fragments that ran Light::calculate since the rasterizer was created
+     */
+    size_t getShadedFragments() const;
+
+    int getWidth() const;
+
+    int getHeight() const;
+
+    int getSamples() const;
+
+    /*
+     * position of a sample around its pixel in 1 / sampleScale pixel units, (0, 0) on single sample targets
+     */
+    static void getSampleOffset(int samples, int index, int& x, int& y);
+
+    static constexpr int sampleScale = 16;
+
+    /*
+     * pixels shaded together between depth tests, see shadePending
+     */
+    static constexpr size_t shadeBatch = 64;
+
+private:
+    /*
+     * per triangle constants, the edge functions are dx * (y - y0) - dy * (x - x0) and all of them are
+     * non negative inside, the barycentrics are the opposite edge functions over the area
+     */
+    struct TriangleSetup
+    {
+        PixelRect bounds;                    // clamped to the scissor, or only to the target when prepared
+        int x1, y1, x2, y2, x3, y3;
+        int dx12, dx23, dx31;
+        int dy12, dy23, dy31;
+        int bias1, bias2, bias3;             // top-left rule, -1 excludes pixels exactly on the edge
+        int area;                            // twice the signed area, negative for triangles that cover pixels
+        float inverseArea;
+        bool small;                          // at most 4 candidate pixels
+
+        void barycentrics(int x, int y, float& lambda1, float& lambda2) const {
+            lambda1 = -(dx23 * (y - y2) - dy23 * (x - x2)) * inverseArea;
+            lambda2 = -(dx31 * (y - y3) - dy31 * (x - x3)) * inverseArea;
+        }
+    };
+
+    /*
+     * attribute / w and 1 / w of the vertices as planes over the screen space barycentrics,
+     * value = base + lambda1 * step1 + lambda2 * step2, set up once per triangle
+     */
+    struct AttributePlanes
+    {
+        static constexpr int count = 7;      // 1 / w, normal, texture coordinates
+        float base[count];
+        float step1[count];
+        float step2[count];
+
+        AttributePlanes() = default;
+
+        AttributePlanes(const Vertex& f1, const Vertex& f2, const Vertex& f3, const float3& inverseW);
+
+        // perspective correct normal, not normalized, and texture coordinates
+        void interpolate(float lambda1, float lambda2, Fragment& fragment) const;
+    };
+
+public:
+    /*
+     * drawTriangle split in two: the setup and attribute planes of a triangle in canonical space, built
+     * without touching the target so geometry threads can run it, and the fill from that record
+     */
+    struct PreparedTriangle
+    {
+        TriangleSetup setup;
+        AttributePlanes planes;
+        float3 positions[3];                 // canonical, z is the depth
+        bool curved;                         // see selectShadingRate
+    };
+
+    /*
+     * false for triangles every draw would reject as zero area or counterclockwise, the scissor is not
+     * considered here but when the triangle is drawn
+     */
+    bool prepareTriangle(const float3& p1, const float3& p2, const float3& p3, const Vertex& f1, const Vertex& f2, const Vertex& f3, const float3& inverseW, PreparedTriangle& prepared) const;
+
+    void drawPrepared(const PreparedTriangle& prepared, const Light& light);
+
+    // depth only variant of drawPrepared
+    void drawPreparedDepth(const PreparedTriangle& prepared);
+
 private:
     int toPixelX(float x) const;
 
     int toPixelY(float y) const;
 
+    void fillTriangle(int x1, int y1, float z1, const float3& normal1, int x2, int y2, float z2, const float3& normal2, int x3, int y3, float z3, const float3& normal3, const Light& light, const std::vector<float3>& positions, const Vertex& f1, const Vertex& f2, const Vertex& f3, const float3& inverseW);
+
+    // Light::calculate at the barycentrics, fragment is scratch space reused across calls
+    float3 shadeFragment(const AttributePlanes& planes, const float3* positions, const Light& light, float lambda1, float lambda2, float lambda3, Fragment& fragment);
+
+    // single sample fill at the shading rate picked for the triangle
+    void fillTriangleShaded(const TriangleSetup& setup, const AttributePlanes& planes, const float3* positions, bool curved, const Light& light);
+
+    /*
+     * single sample fill shading a lattice every rate pixels, shade(lambda1, lambda2, lambda3) returns the color
+     * at a lattice point, the lattice storage is reused across triangles
+     */
+    template <class Shade>
+    void fillTriangleCoarse(const TriangleSetup& setup, int rate, float z1, float z2, float z3, Shade&& shade);
+
+    /*
+     * depth test of a single sample triangle, write(pixel) runs for every pixel that passed through shadePending
+     */
+    template <class Write>
+    void fillPixels(const TriangleSetup& setup, float z1, float z2, float z3, Write&& write);
+
+    // depth only variant of fillTriangle, no attribute interpolation or shading
+    void fillTriangleDepth(int x1, int y1, float z1, int x2, int y2, float z2, int x3, int y3, float z3);
+
+    void fillDepth(const TriangleSetup& setup, float z1, float z2, float z3);
+
+    void fillTriangleVertex(int x1, int y1, float z1, const float3& vertexColor1, int x2, int y2, float z2, const float3& vertexColor2, int x3, int y3, float z3, const float3& vertexColor3);
+
+    /*
+     * a covered pixel that passed the depth test, waiting for shading
+     */
+    struct PendingPixel
+    {
+        int x;
+        int y;
+        float lambda1;
+        float lambda2;
+        unsigned samples;                    // mask of the samples that passed, multisample targets only
+    };
+
+    /*
+     * coverage and depth per sample, write(pixel) runs once per pixel with a passing sample through
+     * shadePending, nothing is written when shaded is false
+     */
+    template <class Write>
+    void fillTriangleMultisample(int x1, int y1, float z1, int x2, int y2, float z2, int x3, int y3, float z3, bool shaded, Write&& write);
+
+    /*
+     * queues a pixel and shades the queue once it holds shadeBatch pixels
+     */
+    template <class Write>
+    void addPending(const PendingPixel& pixel, Write&& write);
+
+    /*
+     * write(pixel) for every queued pixel inside one Shade stage scope, so the stage timer runs per batch
+     * instead of per pixel
+     */
+    template <class Write>
+    void shadePending(Write&& write);
+
+    bool passesDepthTest(float depth, float stored) const;
+
+    /*
+     * false for triangles that cannot cover a pixel: zero area, counterclockwise or outside clip
+     */
+    bool setupTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const PixelRect& clip, TriangleSetup& setup) const;
+
+    // a prepared setup with its bounds narrowed to the scissor, false when nothing is left
+    bool clipToScissor(const TriangleSetup& prepared, TriangleSetup& setup) const;
+
+    // visit(x, y, lambda1, lambda2) for every covered pixel
+    template <class Visit>
+    void forEachCoveredPixel(const TriangleSetup& setup, Visit&& visit) const;
+
+    // lattice spacing in pixels for a triangle covering area pixels, curved triangles stay at full rate when adaptive
+    int selectShadingRate(float area, bool curved) const;
+
 private:
-    BMP& mBuffer;
+    RenderTarget& mTarget;
+    VertexProcessor& mVertexProcessor;
+    std::shared_ptr<BMP> mTexture;
+    DepthTest mDepthTest = DepthTest::Less;
+    ShadingRate mShadingRate = ShadingRate::Rate1x1;
+    std::vector<float3> mCoarseColors;       // lattice of the triangle being filled
+    std::vector<uint32_t> mCoarseStamps;     // a lattice point is shaded when its stamp equals mCoarseStamp
+    uint32_t mCoarseStamp = 0;               // bumped per triangle so the lattice is never cleared
+    std::vector<PendingPixel> mPending;
+    size_t mShadedFragments = 0;
+    PixelRect mScissor;
+    bool mScissored = false;
 };
\ No newline at end of file
@@ -0,0 +1,762 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/resource.h>
+#include "BMP.h"
+#include "rasterizer.hpp"
+#include "render_stats.hpp"
+#include "render_queue.hpp"
+#include "render_target.hpp"
+#include "retained_scene.hpp"
+#include "vertex_processor.hpp"
+#include "mesh.hpp"
+#include "sphere.hpp"
+#include "point_light.hpp"
+
+namespace {
+
+long peakRssKb()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double nowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * sums several lights, the rasterizer shades every draw with a single Light
+ */
+class LightSet : public Light {
+public:
+    explicit LightSet(std::vector<const Light*> lights) : Light({0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, 0), mLights(std::move(lights)) {
+    }
+
+    float3 calculate(const Fragment &fragment, VertexProcessor &vertexProcessor, std::shared_ptr<BMP> texture) const override {
+        float3 sum{0.0f, 0.0f, 0.0f};
+        for (const auto* light : mLights)
+        {
+            sum += light->calculate(fragment, vertexProcessor, texture);
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            sum[i] = std::min(sum[i], 1.0f);
+        }
+        return sum;
+    }
+
+    void setupShadowProjection(VertexProcessor &lightProcessor, const float3 &center, float radius) const override {
+        mLights.front()->setupShadowProjection(lightProcessor, center, radius);
+    }
+
+private:
+    std::vector<const Light*> mLights;
+};
+
+// cells x cells quads facing the camera, two triangles each
+std::shared_ptr<Mesh> createGrid(int cells, float halfSize)
+{
+    std::vector<Vertex> vertices;
+    std::vector<int3> indices;
+    for (int y = 0; y <= cells; y++)
+    {
+        for (int x = 0; x <= cells; x++)
+        {
+            Vertex vertex;
+            vertex.position = float3{-halfSize + 2 * halfSize * x / cells, -halfSize + 2 * halfSize * y / cells, 0.0f};
+            vertex.normal = float3{0.0f, 0.0f, 1.0f};
+            vertex.textureCoords = float3{(float)x / cells, (float)y / cells, 0.0f};
+            vertices.push_back(vertex);
+        }
+    }
+    for (int y = 0; y < cells; y++)
+    {
+        for (int x = 0; x < cells; x++)
+        {
+            const int i = y * (cells + 1) + x;
+            // winding accepted by Rasterizer::fillTriangle for a surface facing the camera
+            indices.push_back(int3{i, i + 1, i + cells + 1});
+            indices.push_back(int3{i + 1, i + cells + 2, i + cells + 1});
+        }
+    }
+    return std::make_shared<Mesh>(std::move(vertices), std::move(indices), true, true);
+}
+
+// checkerboard, the bench does not depend on texture files
+std::shared_ptr<BMP> createCheckerTexture(VertexProcessor& vertexProcessor, int size, int cells)
+{
+    auto texture = std::make_shared<BMP>(size, size, vertexProcessor, false);
+    const int cell = size / cells;
+    for (int y = 0; y < cells; y++)
+    {
+        for (int x = 0; x < cells; x++)
+        {
+            const uint8_t c = (x + y) % 2 ? 160 : 40;
+            texture->fill_region(x * cell, y * cell, cell, cell, c, c, c, 255);
+        }
+    }
+    return texture;
+}
+
+struct Scene
+{
+    std::string name;
+    std::shared_ptr<Mesh> mesh;
+    float4x4 transform;
+    bool textured;
+    int lights;
+    int samples = 1;
+    ShadingRate shadingRate = ShadingRate::Rate1x1;
+    VertexFormat vertexFormat = VertexFormat::Full;
+};
+
+struct Resolution
+{
+    int width;
+    int height;
+};
+
+struct Result
+{
+    std::string name;
+    double ms;
+    double mtrisPerS;
+    double mpixPerS;
+    double nsPerVertex;                      // transform stage per vertex, needs RENDER_STATS
+    long peakRssKb;
+    size_t shadedFragments = 0;
+    size_t smallTriangles = 0;               // triangle setup counters, need RENDER_STATS
+    size_t rejectedTriangles = 0;
+    double rmse = 0.0;                       // against full rate shading, 0-255 scale
+    double fullRateMs = 0.0;                 // the same scene at full rate, coarse shading rates only
+    size_t vertexBytes = 0;                  // vertex storage of the mesh in its format
+    size_t occludedMeshes = 0;
+};
+
+Result runScene(const Scene& scene, const Resolution& resolution, int iterations)
+{
+    VertexProcessor vertexProcessor;
+    vertexProcessor.setPerspective(90, (float)resolution.width / resolution.height, 0.5, 100);
+    RenderTarget target(resolution.width, resolution.height, ColorFormat::RGBA8, scene.samples);
+    Rasterizer rasterizer(target, vertexProcessor);
+
+    std::vector<PointLight> pointLights;
+    for (int i = 0; i < scene.lights; i++)
+    {
+        pointLights.emplace_back(float3{(float)i - (scene.lights - 1) * 0.5f, 1.0f, 0.0f}, float3{0.1f / scene.lights, 0.1f / scene.lights, 0.1f / scene.lights},
+                                 float3{0.4f, 0.4f, 0.4f}, float3{0.5f, 0.5f, 0.5f}, 12.0f);
+    }
+    std::vector<const Light*> lightPointers;
+    for (const auto& light : pointLights)
+    {
+        lightPointers.push_back(&light);
+    }
+    LightSet lightSet(lightPointers);
+
+    MeshInstance instance;
+    instance.transform = scene.transform;
+    instance.light = scene.lights == 1 ? lightPointers.front() : &lightSet;
+    if (scene.textured)
+    {
+        instance.texture = createCheckerTexture(vertexProcessor, 256, 8);
+    }
+    rasterizer.bindTexture(instance.texture);
+    rasterizer.setShadingRate(scene.shadingRate);
+    scene.mesh->setVertexFormat(scene.vertexFormat);
+    scene.mesh->prepare();
+
+    std::vector<double> times;
+    std::vector<double> transformTimes;
+    size_t shaded = 0;
+    RenderStats stats;
+    for (int i = 0; i <= iterations; i++)
+    {
+        target.clearColor({0.0f, 0.0f, 0.0f});
+        target.clearDepth();
+        const size_t shadedBefore = rasterizer.getShadedFragments();
+        Profiler::beginFrame();
+        const double start = nowMs();
+        scene.mesh->drawInstance(rasterizer, vertexProcessor, instance);
+        const double ms = nowMs() - start;
+        stats = Profiler::endFrame(0);
+        shaded = rasterizer.getShadedFragments() - shadedBefore;
+        // first iteration warms up caches and the lazy mesh state
+        if (i > 0)
+        {
+            times.push_back(ms);
+            transformTimes.push_back(stats.stageMs[(int)RenderStage::Transform]);
+        }
+    }
+    std::sort(times.begin(), times.end());
+    std::sort(transformTimes.begin(), transformTimes.end());
+    const double ms = times[times.size() / 2];
+
+    Result result;
+    result.name = scene.name + "@" + std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+    result.ms = ms;
+    result.mtrisPerS = scene.mesh->getIndices().size() / (ms * 1000.0);
+    result.mpixPerS = shaded / (ms * 1000.0);
+    result.nsPerVertex = transformTimes[transformTimes.size() / 2] * 1.0e6 / scene.mesh->getVertexCount();
+    result.peakRssKb = peakRssKb();
+    result.shadedFragments = shaded;
+    result.smallTriangles = stats.trianglesSmall;
+    result.rejectedTriangles = stats.trianglesRejected;
+    result.vertexBytes = scene.mesh->getVertexMemory();
+    if (scene.shadingRate != ShadingRate::Rate1x1)
+    {
+        RenderTarget reference(resolution.width, resolution.height, ColorFormat::RGBA8, scene.samples);
+        Rasterizer referenceRasterizer(reference, vertexProcessor);
+        referenceRasterizer.bindTexture(instance.texture);
+        // timed the same way so the saved shading is weighed against the lattice overhead
+        std::vector<double> fullRateTimes;
+        for (int i = 0; i <= iterations; i++)
+        {
+            reference.clearColor({0.0f, 0.0f, 0.0f});
+            reference.clearDepth();
+            const double start = nowMs();
+            scene.mesh->drawInstance(referenceRasterizer, vertexProcessor, instance);
+            if (i > 0)
+            {
+                fullRateTimes.push_back(nowMs() - start);
+            }
+        }
+        std::sort(fullRateTimes.begin(), fullRateTimes.end());
+        result.fullRateMs = fullRateTimes[fullRateTimes.size() / 2];
+        double squares = 0.0;
+        for (int y = 0; y < resolution.height; y++)
+        {
+            for (int x = 0; x < resolution.width; x++)
+            {
+                const float3 difference = (target.getPixel(x, y) - reference.getPixel(x, y)) * 255.0f;
+                squares += difference.dotProduct(difference);
+            }
+        }
+        result.rmse = std::sqrt(squares / (3.0 * resolution.width * resolution.height));
+    }
+    return result;
+}
+
+/*
+ * 16 spheres where one moves every frame, redrawn from scratch and through RetainedScene
+ */
+std::vector<Result> runRetained(const Resolution& resolution, int iterations)
+{
+    VertexProcessor vertexProcessor;
+    vertexProcessor.setPerspective(90, (float)resolution.width / resolution.height, 0.5, 100);
+    RenderTarget target(resolution.width, resolution.height);
+    Rasterizer rasterizer(target, vertexProcessor);
+    PointLight light(float3{0.0f, 1.0f, 0.0f}, float3{0.1f, 0.1f, 0.1f}, float3{0.4f, 0.4f, 0.4f}, float3{0.5f, 0.5f, 0.5f}, 12.0f);
+    Vertex center;
+    Sphere sphere(15, 32, center, 0.3f);
+
+    RenderQueue queue;
+    RetainedScene scene;
+    std::vector<MeshInstance> instances(16);
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        instances[i].transform = VertexProcessor::translation(float3{(float)(i % 4) - 1.5f, (float)(i / 4) - 1.5f, -3.0f});
+        instances[i].light = &light;
+        scene.add(sphere, instances[i]);
+    }
+    scene.render(queue, rasterizer, target, vertexProcessor);
+
+    const int frames = iterations * 8;
+    auto moved = [&](int frame) {
+        MeshInstance instance = instances[5];
+        instance.transform = VertexProcessor::translation(float3{-0.5f + 0.05f * (frame % 8), -0.5f, -3.0f});
+        return instance;
+    };
+    double start = nowMs();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        target.clearColor({0.0f, 0.0f, 0.0f});
+        target.clearDepth();
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            queue.submit(sphere, i == 5 ? moved(frame) : instances[i]);
+        }
+        queue.flush(rasterizer, vertexProcessor);
+    }
+    const double fullMs = (nowMs() - start) / frames;
+
+    size_t redrawnPixels = 0;
+    start = nowMs();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        scene.update(5, moved(frame));
+        scene.render(queue, rasterizer, target, vertexProcessor);
+        redrawnPixels += scene.getStats().redrawnPixels;
+    }
+    const double retainedMs = (nowMs() - start) / frames;
+
+    const std::string suffix = "@" + std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+    Result full{};
+    full.name = "retained_full_redraw" + suffix;
+    full.ms = fullMs;
+    full.mpixPerS = (double)resolution.width * resolution.height / (fullMs * 1000.0);
+    full.peakRssKb = peakRssKb();
+    Result incremental{};
+    incremental.name = "retained_one_moving" + suffix;
+    incremental.ms = retainedMs;
+    incremental.mpixPerS = (double)redrawnPixels / frames / (retainedMs * 1000.0);
+    incremental.peakRssKb = peakRssKb();
+    return {full, incremental};
+}
+
+/*
+ * a large sphere in front of a grid of detailed ones, drawn through the queue without and with occlusion culling
+ */
+std::vector<Result> runOcclusion(const Resolution& resolution, int iterations)
+{
+    VertexProcessor vertexProcessor;
+    vertexProcessor.setPerspective(90, (float)resolution.width / resolution.height, 0.5, 100);
+    RenderTarget target(resolution.width, resolution.height);
+    Rasterizer rasterizer(target, vertexProcessor);
+    PointLight light(float3{0.0f, 1.0f, 0.0f}, float3{0.1f, 0.1f, 0.1f}, float3{0.4f, 0.4f, 0.4f}, float3{0.5f, 0.5f, 0.5f}, 12.0f);
+    Vertex center;
+    Sphere occluder(31, 64, center, 1.0f);
+    Sphere hidden(31, 64, center, 0.15f);
+
+    MeshInstance front;
+    front.transform = VertexProcessor::translation(float3{0.0f, 0.0f, -1.6f});
+    front.light = &light;
+    front.occluder = true;
+    std::vector<MeshInstance> behind(64);
+    for (size_t i = 0; i < behind.size(); i++)
+    {
+        behind[i].transform = VertexProcessor::translation(float3{(float)(i % 8) * 0.3f - 1.05f, (float)(i / 8) * 0.3f - 1.05f, -4.0f});
+        behind[i].light = &light;
+    }
+
+    const std::string suffix = "@" + std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+    std::vector<Result> results;
+    RenderQueue queue;
+    for (const bool culling : {false, true})
+    {
+        queue.setOcclusionCulling(culling);
+        const int frames = iterations * 4;
+        const double start = nowMs();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            target.clearColor({0.0f, 0.0f, 0.0f});
+            target.clearDepth();
+            queue.submit(occluder, front);
+            for (const auto& instance : behind)
+            {
+                queue.submit(hidden, instance);
+            }
+            queue.flush(rasterizer, vertexProcessor);
+        }
+        Result result{};
+        result.name = (culling ? "occlusion_culled" : "occlusion_drawn") + suffix;
+        result.ms = (nowMs() - start) / frames;
+        result.mtrisPerS = (occluder.getIndices().size() + behind.size() * hidden.getIndices().size()) / (result.ms * 1000.0);
+        result.mpixPerS = queue.getStats().shadedFragments / (result.ms * 1000.0);
+        result.shadedFragments = queue.getStats().shadedFragments;
+        result.occludedMeshes = queue.getStats().occluded;
+        result.peakRssKb = peakRssKb();
+        results.push_back(result);
+    }
+    return results;
+}
+
+/*
+ * vertex stage and triangle setup of RenderQueue::prepare over four grids of half a million triangles each,
+ * with the geometry on 1, 2 and 4 threads, nothing is rasterized
+ */
+std::vector<Result> runGeometry(const Resolution& resolution, int iterations)
+{
+    VertexProcessor vertexProcessor;
+    vertexProcessor.setPerspective(90, (float)resolution.width / resolution.height, 0.5, 100);
+    RenderTarget target(resolution.width, resolution.height);
+    Rasterizer rasterizer(target, vertexProcessor);
+    PointLight light(float3{0.0f, 1.0f, 0.0f}, float3{0.1f, 0.1f, 0.1f}, float3{0.4f, 0.4f, 0.4f}, float3{0.5f, 0.5f, 0.5f}, 12.0f);
+    const auto grid = createGrid(512, 0.5f);
+    std::vector<MeshInstance> instances(4);
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        instances[i].transform = VertexProcessor::translation(float3{(float)(i % 2) - 0.5f, (float)(i / 2) - 0.5f, -2.0f});
+        instances[i].light = &light;
+    }
+    const size_t triangles = instances.size() * grid->getIndices().size();
+
+    const std::string suffix = "@" + std::to_string(resolution.width) + "x" + std::to_string(resolution.height);
+    std::vector<Result> results;
+    RenderQueue queue;
+    PreparedFrame frame;
+    for (const size_t threads : {1, 2, 4})
+    {
+        queue.setGeometryThreads(threads);
+        const auto prepareFrame = [&] {
+            for (const auto& instance : instances)
+            {
+                queue.submit(*grid, instance);
+            }
+            queue.prepare(frame, rasterizer, vertexProcessor);
+        };
+        // the first frame also builds the meshlets of the grid
+        prepareFrame();
+        const double start = nowMs();
+        for (int i = 0; i < iterations; i++)
+        {
+            prepareFrame();
+        }
+        Result result{};
+        result.name = "geometry_" + std::to_string(threads) + "_threads" + suffix;
+        result.ms = (nowMs() - start) / iterations;
+        result.mtrisPerS = triangles / (result.ms * 1000.0);
+        result.peakRssKb = peakRssKb();
+        results.push_back(result);
+    }
+    return results;
+}
+
+template <class F>
+Result runMicro(const std::string& name, size_t operations, F&& f)
+{
+    const double start = nowMs();
+    f();
+    const double ms = nowMs() - start;
+    Result result{};
+    result.name = name;
+    result.ms = ms;
+    result.nsPerVertex = ms * 1.0e6 / operations;
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+std::vector<Result> runMicroBenchmarks()
+{
+    constexpr size_t count = 200000;
+    std::vector<Result> results;
+    // sinks keep the optimizer from dropping the loops
+    volatile float sink = 0.0f;
+
+    const float3 a{0.3f, 0.5f, 0.7f};
+    const float3 b{0.9f, 0.1f, 0.4f};
+    results.push_back(runMicro("micro_vector_dot_cross_normalize", count, [&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto c = crossProduct(a, b);
+            c.normalize();
+            sum += c.dotProduct(a);
+        }
+        sink = sum;
+    }));
+
+    // exception checked and unchecked variants of the per pixel operations
+    results.push_back(runMicro("micro_vector_normalize_checked", count, [&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            float3 n{a.x(), a.y() + (float)(i & 15), a.z()};
+            n.normalize();
+            sum += n.x();
+        }
+        sink = sum;
+    }));
+    results.push_back(runMicro("micro_vector_normalize_unchecked", count, [&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            float3 n{a.x(), a.y() + (float)(i & 15), a.z()};
+            n.normalizeUnchecked();
+            sum += n.x();
+        }
+        sink = sum;
+    }));
+
+    const float4x4 matrix = VertexProcessor::rotation(30.0f, float3{0.0f, 1.0f, 0.0f});
+    results.push_back(runMicro("micro_vector_float4_times_float4x4", count, [&] {
+        float4 v{1.0f, 2.0f, 3.0f, 1.0f};
+        for (size_t i = 0; i < count; i++)
+        {
+            v *= matrix;
+        }
+        sink = v.x();
+    }));
+
+    VertexProcessor vertexProcessor;
+    vertexProcessor.setPerspective(90, 1, 0.5, 100);
+    vertexProcessor.multByTranslation(float3{0.0f, 0.0f, -2.0f});
+    results.push_back(runMicro("micro_convert_to_canonical", count, [&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += vertexProcessor.convertToCanonical(a).z();
+        }
+        sink = sum;
+    }));
+
+    const auto texture = createCheckerTexture(vertexProcessor, 256, 8);
+    results.push_back(runMicro("micro_get_pixel", count, [&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += texture->get_pixel(i & 255, (i >> 8) & 255).r();
+        }
+        sink = sum;
+    }));
+    results.push_back(runMicro("micro_get_pixel_unchecked", count, [&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += texture->get_pixel_unchecked(i & 255, (i >> 8) & 255).r();
+        }
+        sink = sum;
+    }));
+
+    for (const auto quality : {LightingQuality::Exact, LightingQuality::Fast})
+    {
+        PointLight light(float3{0.0f, 1.0f, 0.0f}, float3{0.1f, 0.1f, 0.1f}, float3{0.4f, 0.4f, 0.4f}, float3{0.5f, 0.5f, 0.5f}, 12.0f);
+        light.setQuality(quality);
+        Fragment fragment;
+        fragment.position = float3{0.1f, 0.2f, -2.0f};
+        results.push_back(runMicro(quality == LightingQuality::Exact ? "micro_phong_exact" : "micro_phong_fast", count, [&] {
+            float sum = 0.0f;
+            for (size_t i = 0; i < count; i++)
+            {
+                fragment.normal = float3{(float)(i & 63) / 64.0f - 0.5f, 0.5f, 1.0f};
+                sum += light.calculate(fragment, vertexProcessor).r();
+            }
+            sink = sum;
+        }));
+    }
+    return results;
+}
+
+/*
+ * largest channel difference between LightingQuality::Fast and Exact over normals, positions and shininess values
+ */
+float measureFastLightingError()
+{
+    VertexProcessor vertexProcessor;
+    float error = 0.0f;
+    for (const float shininess : {0.0f, 1.0f, 12.0f, 64.0f, 250.0f, 1000.0f})
+    {
+        PointLight exact(float3{0.3f, 1.0f, 0.5f}, float3{0.1f, 0.1f, 0.1f}, float3{0.4f, 0.4f, 0.4f}, float3{1.0f, 1.0f, 1.0f}, shininess);
+        PointLight fast = exact;
+        fast.setQuality(LightingQuality::Fast);
+        for (int i = 0; i < 20000; i++)
+        {
+            // points on a sphere in front of the camera, unnormalized normals as interpolation leaves them
+            const float theta = i * 0.7548777f * 6.2831853f;
+            const float phi = std::acos(1.0f - 2.0f * ((i * 0.5698403f) - std::floor(i * 0.5698403f)));
+            const float3 normal{std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta), std::cos(phi)};
+            Fragment fragment;
+            fragment.normal = normal * (0.8f + 0.4f * (i % 7) / 6.0f);
+            fragment.position = normal * 0.5f + float3{0.0f, 0.0f, -2.0f};
+            const float3 difference = exact.calculate(fragment, vertexProcessor) - fast.calculate(fragment, vertexProcessor);
+            for (int c = 0; c < 3; c++)
+            {
+                error = std::max(error, std::fabs(difference[c]));
+            }
+        }
+    }
+    return error;
+}
+
+void writeJson(std::ostream& os, const std::vector<Result>& results)
+{
+    os << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto& r = results[i];
+        os << "{\"name\":\"" << r.name << "\",\"ms\":" << r.ms << ",\"mtrisPerS\":" << r.mtrisPerS << ",\"mpixPerS\":" << r.mpixPerS
+           << ",\"nsPerVertex\":" << r.nsPerVertex << ",\"peakRssKb\":" << r.peakRssKb
+           << ",\"shadedFragments\":" << r.shadedFragments << ",\"rmse\":" << r.rmse << ",\"fullRateMs\":" << r.fullRateMs << ",\"vertexBytes\":" << r.vertexBytes << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    os << "]\n";
+}
+
+// reads the files written by writeJson, one result per line
+std::map<std::string, double> readBaseline(const std::string& fname)
+{
+    std::ifstream in{ fname };
+    if (!in)
+    {
+        throw std::runtime_error("Unable to open the baseline file.");
+    }
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const auto name = line.find("\"name\":\"");
+        const auto ms = line.find("\"ms\":");
+        if (name == std::string::npos || ms == std::string::npos)
+        {
+            continue;
+        }
+        const auto nameEnd = line.find('"', name + 8);
+        baseline[line.substr(name + 8, nameEnd - name - 8)] = std::stod(line.substr(ms + 5));
+    }
+    return baseline;
+}
+
+}
+
+/*
+ * usage: rasterizer_bench [--full] [--iterations N] [--json out.json] [--compare baseline.json] [--threshold percent]
+ * --full adds 1080p, 4K and 8K targets, --compare exits with 1 when a result is slower than the baseline by more than the threshold
+ */
+int main(int argc, char** argv) {
+    bool full = false;
+    int iterations = 3;
+    std::string jsonFile;
+    std::string compareFile;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--full")
+        {
+            full = true;
+        }
+        else if (arg == "--iterations" && i + 1 < argc)
+        {
+            iterations = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            jsonFile = argv[++i];
+        }
+        else if (arg == "--compare" && i + 1 < argc)
+        {
+            compareFile = argv[++i];
+        }
+        else if (arg == "--threshold" && i + 1 < argc)
+        {
+            threshold = std::stod(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+#ifndef NDEBUG
+    std::cerr << "warning: assertions are enabled, configure with -DCMAKE_BUILD_TYPE=Release for comparable numbers" << std::endl;
+#endif
+#ifdef RENDER_STATS
+    std::cerr << "warning: render statistics time every triangle, configure with -DRENDER_STATS=OFF for comparable frame times" << std::endl;
+#endif
+
+    const float4x4 inFront = VertexProcessor::translation(float3{0.0f, 0.0f, -2.0f});
+    Vertex center;
+    std::vector<Scene> scenes;
+    for (const int segments : {8, 16, 32, 64})
+    {
+        scenes.push_back({"sphere_" + std::to_string(segments), std::make_shared<Sphere>(segments / 2 - 1, segments, center, 0.5f), inFront, false, 1});
+    }
+    scenes.push_back({"sphere_64_textured", std::make_shared<Sphere>(31, 64, center, 0.5f), inFront, true, 1});
+    scenes.push_back({"sphere_64_textured_packed", std::make_shared<Sphere>(31, 64, center, 0.5f), inFront, true, 1, 1, ShadingRate::Rate1x1, VertexFormat::Packed});
+    scenes.push_back({"sphere_64_4_lights", std::make_shared<Sphere>(31, 64, center, 0.5f), inFront, false, 4});
+    scenes.push_back({"sphere_64_msaa4", std::make_shared<Sphere>(31, 64, center, 0.5f), inFront, false, 1, 4});
+    scenes.push_back({"sphere_64_msaa8", std::make_shared<Sphere>(31, 64, center, 0.5f), inFront, false, 1, 8});
+    scenes.push_back({"sphere_16_rate2x2", std::make_shared<Sphere>(7, 16, center, 0.5f), inFront, false, 1, 1, ShadingRate::Rate2x2});
+    scenes.push_back({"sphere_16_rate4x4", std::make_shared<Sphere>(7, 16, center, 0.5f), inFront, false, 1, 1, ShadingRate::Rate4x4});
+    scenes.push_back({"sphere_64_rate_adaptive", std::make_shared<Sphere>(31, 64, center, 0.5f), inFront, false, 1, 1, ShadingRate::Adaptive});
+    scenes.push_back({"huge_triangles_rate4x4", createGrid(1, 4.0f), inFront, false, 1, 1, ShadingRate::Rate4x4});
+    scenes.push_back({"small_triangles", createGrid(160, 1.0f), inFront, false, 1});
+    scenes.push_back({"micro_triangles", createGrid(400, 1.0f), inFront, false, 1});
+    scenes.push_back({"micro_triangles_packed", createGrid(400, 1.0f), inFront, false, 1, 1, ShadingRate::Rate1x1, VertexFormat::Packed});
+    scenes.push_back({"micro_triangles_half", createGrid(400, 1.0f), inFront, false, 1, 1, ShadingRate::Rate1x1, VertexFormat::PackedHalfPosition});
+    scenes.push_back({"small_triangles_textured", createGrid(160, 1.0f), inFront, true, 1});
+    scenes.push_back({"huge_triangles", createGrid(1, 4.0f), inFront, false, 1});
+    scenes.push_back({"huge_triangles_textured", createGrid(1, 4.0f), inFront, true, 1});
+
+    std::vector<Resolution> resolutions{{400, 400}, {1280, 720}};
+    if (full)
+    {
+        resolutions.push_back({1920, 1080});
+        resolutions.push_back({3840, 2160});
+        resolutions.push_back({7680, 4320});
+    }
+
+    std::vector<Result> results;
+    for (const auto& resolution : resolutions)
+    {
+        for (const auto& scene : scenes)
+        {
+            results.push_back(runScene(scene, resolution, iterations));
+            const auto& r = results.back();
+            std::cout << r.name << ": " << r.ms << " ms, " << r.mtrisPerS << " Mtris/s, " << r.mpixPerS << " Mpix/s, "
+                      << r.nsPerVertex << " ns/vertex, peak rss " << r.peakRssKb / 1024 << " MB, " << r.shadedFragments << " shaded, "
+                      << r.smallTriangles << " small and " << r.rejectedTriangles << " rejected triangles, " << r.vertexBytes / 1024 << " KB of vertices";
+            if (scene.shadingRate != ShadingRate::Rate1x1)
+            {
+                std::cout << ", rmse " << r.rmse << " against full rate at " << r.fullRateMs << " ms";
+            }
+            std::cout << std::endl;
+        }
+    }
+    for (const auto& resolution : resolutions)
+    {
+        for (const auto& r : runRetained(resolution, iterations))
+        {
+            results.push_back(r);
+            std::cout << r.name << ": " << r.ms << " ms per frame, " << r.mpixPerS << " Mpix/s redrawn" << std::endl;
+        }
+    }
+    for (const auto& resolution : resolutions)
+    {
+        for (const auto& r : runOcclusion(resolution, iterations))
+        {
+            results.push_back(r);
+            std::cout << r.name << ": " << r.ms << " ms per frame, " << r.shadedFragments << " shaded, " << r.occludedMeshes
+                      << " of 64 meshes occluded" << std::endl;
+        }
+    }
+    for (const auto& r : runGeometry(resolutions.front(), iterations))
+    {
+        results.push_back(r);
+        std::cout << r.name << ": " << r.ms << " ms per frame, " << r.mtrisPerS << " Mtris/s" << std::endl;
+    }
+    for (const auto& r : runMicroBenchmarks())
+    {
+        results.push_back(r);
+        std::cout << r.name << ": " << r.nsPerVertex << " ns/op" << std::endl;
+    }
+
+    if (!jsonFile.empty())
+    {
+        std::ofstream of{ jsonFile };
+        writeJson(of, results);
+    }
+
+    int status = 0;
+    const float lightingError = measureFastLightingError();
+    std::cout << "fast lighting max error " << lightingError << ", bound " << Light::fastMaxError << std::endl;
+    if (lightingError > Light::fastMaxError)
+    {
+        std::cout << "fast lighting exceeds its error bound" << std::endl;
+        status = 1;
+    }
+    if (!compareFile.empty())
+    {
+        const auto baseline = readBaseline(compareFile);
+        for (const auto& r : results)
+        {
+            const auto found = baseline.find(r.name);
+            if (found == baseline.end() || found->second <= 0.0)
+            {
+                continue;
+            }
+            const double change = (r.ms / found->second - 1.0) * 100.0;
+            const bool regression = change > threshold;
+            std::cout << (regression ? "REGRESSION " : "") << r.name << ": " << found->second << " -> " << r.ms << " ms ("
+                      << (change >= 0 ? "+" : "") << change << "%)" << std::endl;
+            status |= regression;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "scene_renderer.hpp"
+
+/*
+ * usage: rasterizer_cli scene... ('-' reads a scene from stdin)
+ * every scene is rendered by the same process, textures, meshes and framebuffers are loaded once
+ */
+int main(int argc, char** argv) {
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " scene..." << std::endl;
+        return 2;
+    }
+    ResourceCache cache;
+    SceneRenderer renderer(cache);
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string fname = argv[i];
+            const size_t framesBefore = renderer.getFrameCount();
+            const auto sceneStart = std::chrono::steady_clock::now();
+            if (fname == "-")
+            {
+                renderer.run(std::cin, "stdin");
+            }
+            else
+            {
+                renderer.run(fname);
+            }
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sceneStart).count();
+            std::cout << fname << ": " << renderer.getFrameCount() - framesBefore << " frames in " << ms << " ms" << std::endl;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << renderer.getFrameCount() << " frames in " << ms << " ms, resource cache " << cache.getHits() << " hits, "
+              << cache.getMisses() << " loads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,360 @@
+#include "render_queue.hpp"
+#include "render_stats.hpp"
+#include "shadow_map.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void RenderQueue::submit(Mesh &mesh, const MeshInstance &instance) {
+    mCommands.push_back({&mesh, nullptr, instance, stateId(mTextures, instance.texture.get()), stateId(mLights, instance.light), 0, 0.0f});
+}
+
+void RenderQueue::submit(LodMesh &mesh, const MeshInstance &instance) {
+    mCommands.push_back({nullptr, &mesh, instance, stateId(mTextures, instance.texture.get()), stateId(mLights, instance.light), 0, 0.0f});
+}
+
+int RenderQueue::stateId(std::vector<const void *> &states, const void *state) {
+    const auto found = std::find(states.begin(), states.end(), state);
+    if (found != states.end())
+    {
+        return found - states.begin();
+    }
+    states.push_back(state);
+    return states.size() - 1;
+}
+
+void RenderQueue::flush(Rasterizer &rasterizer, VertexProcessor &vertexProcessor) {
+    RENDER_STATS_SCOPE("RenderQueue::flush");
+    if (mGeometryScheduler)
+    {
+        // the geometry stage runs on the pool, drawing stays on this thread
+        prepare(mFrame, rasterizer, vertexProcessor);
+        execute(mFrame, rasterizer);
+        return;
+    }
+    mStats = RenderQueueStats();
+    mStats.commands = mCommands.size();
+    const float4x4 previousObj2World = vertexProcessor.getObj2World();
+
+    std::vector<ShadowCaster> casters;
+    std::vector<const Light*> shadowLights;
+    const auto visible = sortVisible(rasterizer, vertexProcessor, casters, shadowLights, mStats);
+    updateShadowMaps(casters, shadowLights, vertexProcessor, mStats);
+
+    const size_t shadedBefore = rasterizer.getShadedFragments();
+    if (mDepthPrepass)
+    {
+        for (const auto* command : visible)
+        {
+            // unlit instances are not drawn by the shading pass either
+            if (command->instance.light != nullptr)
+            {
+                command->mesh->drawInstanceDepth(rasterizer, vertexProcessor, command->instance);
+            }
+        }
+        rasterizer.setDepthTest(DepthTest::Equal);
+    }
+    int boundTexture = -1;
+    for (const auto* visibleCommand : visible)
+    {
+        const auto& command = *visibleCommand;
+        if (command.textureId != boundTexture)
+        {
+            rasterizer.bindTexture(command.instance.texture);
+            boundTexture = command.textureId;
+            mStats.textureBinds++;
+        }
+        command.mesh->drawInstance(rasterizer, vertexProcessor, command.instance);
+    }
+    rasterizer.setDepthTest(DepthTest::Less);
+    mStats.shadedFragments = rasterizer.getShadedFragments() - shadedBefore;
+
+    vertexProcessor.setObj2World(previousObj2World);
+    clear();
+}
+
+void RenderQueue::prepare(PreparedFrame &frame, const Rasterizer &rasterizer, VertexProcessor &vertexProcessor) {
+    RENDER_STATS_SCOPE("RenderQueue::prepare");
+    frame.camera = vertexProcessor;
+    frame.stats = RenderQueueStats();
+    frame.stats.commands = mCommands.size();
+    frame.casters.clear();
+    frame.shadowLights.clear();
+    const auto visible = sortVisible(rasterizer, vertexProcessor, frame.casters, frame.shadowLights, frame.stats);
+
+    frame.draws.resize(visible.size());
+    std::vector<VertexProcessor> processors;
+    size_t count = 0;
+    for (const auto* command : visible)
+    {
+        // unlit instances are skipped by drawInstance as well
+        if (command->instance.light != nullptr && command->mesh->cullInstance(vertexProcessor, command->instance, frame.draws[count]))
+        {
+            processors.push_back(vertexProcessor);
+            count++;
+        }
+    }
+    frame.draws.resize(count);
+    processGeometry(frame.draws, processors, rasterizer);
+    vertexProcessor.setObj2World(frame.camera.getObj2World());
+    clear();
+}
+
+void RenderQueue::execute(const PreparedFrame &frame, Rasterizer &rasterizer) {
+    RENDER_STATS_SCOPE("RenderQueue::execute");
+    mStats = frame.stats;
+    updateShadowMaps(frame.casters, frame.shadowLights, frame.camera, mStats);
+
+    const size_t shadedBefore = rasterizer.getShadedFragments();
+    if (mDepthPrepass)
+    {
+        for (const auto& draw : frame.draws)
+        {
+            draw.mesh->drawTransformed(rasterizer, draw, true);
+        }
+        rasterizer.setDepthTest(DepthTest::Equal);
+    }
+    const BMP* boundTexture = nullptr;
+    for (size_t i = 0; i < frame.draws.size(); i++)
+    {
+        const auto& draw = frame.draws[i];
+        if (i == 0 || draw.instance.texture.get() != boundTexture)
+        {
+            rasterizer.bindTexture(draw.instance.texture);
+            boundTexture = draw.instance.texture.get();
+            mStats.textureBinds++;
+        }
+        draw.mesh->drawTransformed(rasterizer, draw, false);
+    }
+    rasterizer.setDepthTest(DepthTest::Less);
+    mStats.shadedFragments = rasterizer.getShadedFragments() - shadedBefore;
+}
+
+void RenderQueue::processGeometry(std::vector<TransformedInstance> &draws, const std::vector<VertexProcessor> &processors, const Rasterizer &rasterizer) {
+    RENDER_STATS_SCOPE("RenderQueue::processGeometry");
+    const auto runJob = [this](JobScheduler::Job job) {
+        if (mGeometryScheduler)
+        {
+            mGeometryScheduler->submit(std::move(job));
+        }
+        else
+        {
+            job(0);
+        }
+    };
+    const auto waitJobs = [this] {
+        if (mGeometryScheduler)
+        {
+            mGeometryScheduler->wait();
+        }
+    };
+
+    for (size_t d = 0; d < draws.size(); d++)
+    {
+        auto* draw = &draws[d];
+        const auto* processor = &processors[d];
+        for (size_t first = 0; first < draw->used.size(); first += geometryBatch)
+        {
+            const size_t last = std::min(first + geometryBatch, draw->used.size());
+            runJob([draw, processor, first, last](size_t) { draw->mesh->transformVertices(*processor, *draw, first, last); });
+        }
+    }
+    // the setup reads vertices of any span
+    waitJobs();
+
+    struct Span
+    {
+        size_t draw;
+        size_t first;
+        size_t last;
+    };
+    std::vector<Span> spans;
+    for (size_t d = 0; d < draws.size(); d++)
+    {
+        for (const auto& range : draws[d].ranges)
+        {
+            for (size_t first = range.first; first < range.second; first += geometryBatch)
+            {
+                spans.push_back({d, first, std::min(first + geometryBatch, range.second)});
+            }
+        }
+    }
+    // every span writes its own vector of the draw, drawTransformed reads them in span order
+    std::vector<size_t> spanCounts(draws.size(), 0);
+    for (const auto& span : spans)
+    {
+        spanCounts[span.draw]++;
+    }
+    for (size_t d = 0; d < draws.size(); d++)
+    {
+        draws[d].triangles.resize(spanCounts[d]);
+        draws[d].setUp = true;
+    }
+    std::fill(spanCounts.begin(), spanCounts.end(), 0);
+    for (const auto& span : spans)
+    {
+        auto* triangles = &draws[span.draw].triangles[spanCounts[span.draw]++];
+        const auto* draw = &draws[span.draw];
+        const size_t first = span.first;
+        const size_t last = span.last;
+        runJob([triangles, draw, first, last, &rasterizer](size_t) { draw->mesh->setupTriangles(rasterizer, *draw, first, last, *triangles); });
+    }
+    waitJobs();
+}
+
+std::vector<const RenderQueue::DrawCommand *> RenderQueue::sortVisible(const Rasterizer &rasterizer, VertexProcessor &vertexProcessor, std::vector<ShadowCaster> &casters, std::vector<const Light *> &shadowLights, RenderQueueStats &stats) {
+    float minDepth = std::numeric_limits<float>::max();
+    float maxDepth = 0.0f;
+    for (auto& command : mCommands)
+    {
+        vertexProcessor.setObj2World(command.instance.transform);
+        if (command.lod)
+        {
+            command.mesh = &command.lod->selectLevel(rasterizer, vertexProcessor);
+        }
+        command.mesh->prepare();
+        // distance from the camera to the nearest point of the bounding sphere
+        const float3 center = vertexProcessor.convertToView(command.mesh->getBoundingCenter());
+        command.depth = std::max(-center.z() - command.mesh->getBoundingRadius() * vertexProcessor.maxScale(), 0.0f);
+        minDepth = std::min(minDepth, command.depth);
+        maxDepth = std::max(maxDepth, command.depth);
+
+        casters.push_back({command.mesh, command.instance.transform});
+        const Light* light = command.instance.light;
+        if (light && light->getShadowMap() && std::find(shadowLights.begin(), shadowLights.end(), light) == shadowLights.end())
+        {
+            shadowLights.push_back(light);
+        }
+    }
+    // logarithmic buckets keep near objects apart while distant ones share state
+    const float logRange = std::log1p(maxDepth) - std::log1p(minDepth);
+    for (auto& command : mCommands)
+    {
+        const float t = logRange > 0.0f ? (std::log1p(command.depth) - std::log1p(minDepth)) / logRange : 0.0f;
+        command.depthBucket = std::min((int)(t * depthBuckets), depthBuckets - 1);
+    }
+    std::stable_sort(mCommands.begin(), mCommands.end(), [](const DrawCommand& a, const DrawCommand& b) {
+        if (a.depthBucket != b.depthBucket)
+        {
+            return a.depthBucket < b.depthBucket;
+        }
+        if (a.textureId != b.textureId)
+        {
+            return a.textureId < b.textureId;
+        }
+        if (a.lightId != b.lightId)
+        {
+            return a.lightId < b.lightId;
+        }
+        return a.depth < b.depth;
+    });
+
+    std::vector<const DrawCommand*> visible;
+    for (const auto& command : mCommands)
+    {
+        vertexProcessor.setObj2World(command.instance.transform);
+        if (!vertexProcessor.isSphereVisible(command.mesh->getBoundingCenter(), command.mesh->getBoundingRadius()))
+        {
+            stats.culled++;
+            RENDER_STATS_COUNT(trianglesSubmitted, command.mesh->getIndices().size());
+            RENDER_STATS_COUNT(trianglesCulled, command.mesh->getIndices().size());
+            continue;
+        }
+        ScreenBounds bounds;
+        if (rasterizer.hasScissor() && vertexProcessor.projectSphere(command.mesh->getBoundingCenter(), command.mesh->getBoundingRadius(), bounds)
+            && !rasterizer.getScissor().overlaps(rasterizer.getPixelBounds(bounds)))
+        {
+            stats.culled++;
+            RENDER_STATS_COUNT(trianglesSubmitted, command.mesh->getIndices().size());
+            RENDER_STATS_COUNT(trianglesCulled, command.mesh->getIndices().size());
+            continue;
+        }
+        visible.push_back(&command);
+    }
+    if (mOcclusionCulling)
+    {
+        cullOccluded(visible, rasterizer, vertexProcessor, stats);
+    }
+    return visible;
+}
+
+void RenderQueue::cullOccluded(std::vector<const DrawCommand *> &visible, const Rasterizer &rasterizer, VertexProcessor &vertexProcessor, RenderQueueStats &stats) {
+    RENDER_STATS_SCOPE("RenderQueue::cullOccluded");
+    mOcclusionBuffer.reset(rasterizer.getWidth(), rasterizer.getHeight(), rasterizer.getSamples());
+    bool anyOccluder = false;
+    for (const auto* command : visible)
+    {
+        // unlit instances are never drawn, so they hide nothing
+        if (command->instance.occluder && command->instance.light != nullptr)
+        {
+            vertexProcessor.setObj2World(command->instance.transform);
+            mOcclusionBuffer.drawOccluder(*command->mesh, vertexProcessor);
+            anyOccluder = true;
+        }
+    }
+    if (!anyOccluder)
+    {
+        return;
+    }
+    // occluders stay, their own bounds reach in front of what they drew
+    const auto hidden = std::remove_if(visible.begin(), visible.end(), [&](const DrawCommand* command) {
+        if (command->instance.occluder)
+        {
+            return false;
+        }
+        vertexProcessor.setObj2World(command->instance.transform);
+        ScreenBounds bounds;
+        if (!vertexProcessor.projectSphere(command->mesh->getBoundingCenter(), command->mesh->getBoundingRadius(), bounds) || !mOcclusionBuffer.isOccluded(bounds))
+        {
+            return false;
+        }
+        stats.culled++;
+        stats.occluded++;
+        RENDER_STATS_COUNT(trianglesSubmitted, command->mesh->getIndices().size());
+        RENDER_STATS_COUNT(trianglesCulled, command->mesh->getIndices().size());
+        return true;
+    });
+    visible.erase(hidden, visible.end());
+}
+
+void RenderQueue::updateShadowMaps(const std::vector<ShadowCaster> &casters, const std::vector<const Light *> &shadowLights, const VertexProcessor &vertexProcessor, RenderQueueStats &stats) {
+    for (const Light* light : shadowLights)
+    {
+        const auto& shadowMap = light->getShadowMap();
+        if (shadowMap->update(*light, casters))
+        {
+            stats.shadowMapRenders++;
+        }
+        shadowMap->bindCamera(vertexProcessor);
+    }
+}
+
+void RenderQueue::clear() {
+    mCommands.clear();
+    mTextures.clear();
+    mLights.clear();
+}
+
+void RenderQueue::setDepthPrepass(bool enabled) {
+    mDepthPrepass = enabled;
+}
+
+void RenderQueue::setOcclusionCulling(bool enabled) {
+    mOcclusionCulling = enabled;
+}
+
+void RenderQueue::setGeometryThreads(size_t threads) {
+    if (threads == getGeometryThreads())
+    {
+        return;
+    }
+    mGeometryScheduler = threads > 1 ? std::make_unique<JobScheduler>(threads) : nullptr;
+}
+
+size_t RenderQueue::getGeometryThreads() const {
+    return mGeometryScheduler ? mGeometryScheduler->getThreadCount() : 1;
+}
+
+const RenderQueueStats &RenderQueue::getStats() const {
+    return mStats;
+}
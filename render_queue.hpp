@@ -0,0 +1,139 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "job_scheduler.hpp"
+#include "mesh.hpp"
+#include "lod_mesh.hpp"
+#include "occlusion_buffer.hpp"
+#include "shadow_map.hpp"
+
+struct RenderQueueStats
+{
+    size_t commands = 0;
+    size_t culled = 0;
+    size_t occluded = 0;                     // of the culled commands, hidden behind occluders
+    size_t textureBinds = 0;
+    size_t shadowMapRenders = 0;
+    size_t shadedFragments = 0;
+};
+
+/*
+ * the draws of one frame after the vertex stage, in draw order, see RenderQueue::prepare
+ */
+struct PreparedFrame
+{
+    VertexProcessor camera;
+    std::vector<TransformedInstance> draws;
+    std::vector<ShadowCaster> casters;
+    std::vector<const Light*> shadowLights;
+    RenderQueueStats stats;
+};
+
+/*
+ * records draws and executes them sorted front to back, grouped by texture and light within similar depth
+ */
+class RenderQueue {
+public:
+    void submit(Mesh& mesh, const MeshInstance& instance);
+
+    void submit(LodMesh& mesh, const MeshInstance& instance);
+
+    /*
+     * sorts and draws every recorded command, then empties the queue
+     */
+    void flush(Rasterizer& rasterizer, VertexProcessor& vertexProcessor);
+
+    /*
+     * first half of flush: sorts, culls and transforms the recorded commands into the frame, then empties the queue,
+     * touches no render target or shadow map so frames can be prepared on another thread while one is executed
+     */
+    void prepare(PreparedFrame& frame, const Rasterizer& rasterizer, VertexProcessor& vertexProcessor);
+
+    /*
+     * second half: shadow maps, depth prepass and shading of a prepared frame
+     */
+    void execute(const PreparedFrame& frame, Rasterizer& rasterizer);
+
+    const RenderQueueStats& getStats() const;
+
+    /*
+     * rasterizes the visible commands depth only first, then shades them with an equal depth test
+     * so lighting and texture fetches run once per pixel, applies to the following flushes
+     */
+    void setDepthPrepass(bool enabled);
+
+    /*
+     * draws the occluder instances into a coarse depth buffer before the other commands are culled,
+     * commands whose bounds lie behind it are skipped, applies to the following flushes
+     */
+    void setOcclusionCulling(bool enabled);
+
+    /*
+     * runs the vertex transform and the triangle setup of prepare on a pool of threads, meshes and large
+     * vertex and triangle spans become separate jobs, with more than one thread flush goes through prepare
+     * and execute as well, 1 keeps everything on the calling thread
+     */
+    void setGeometryThreads(size_t threads);
+
+    size_t getGeometryThreads() const;
+
+    /*
+     * vertices or triangles per geometry job
+     */
+    static constexpr size_t geometryBatch = 16384;
+
+    /*
+     * view depths within one bucket are drawn in state order instead of strict depth order
+     */
+    static constexpr int depthBuckets = 16;
+
+private:
+    struct DrawCommand
+    {
+        Mesh* mesh;
+        LodMesh* lod;
+        MeshInstance instance;
+        int textureId;
+        int lightId;
+        int depthBucket;
+        float depth;
+    };
+
+    int stateId(std::vector<const void*>& states, const void* state);
+
+    /*
+     * picks levels and sorts, returns the commands left after culling in draw order
+     */
+    std::vector<const DrawCommand*> sortVisible(const Rasterizer& rasterizer, VertexProcessor& vertexProcessor, std::vector<ShadowCaster>& casters, std::vector<const Light*>& shadowLights, RenderQueueStats& stats);
+
+    /*
+     * removes the commands hidden by the occluders among the visible ones
+     */
+    void cullOccluded(std::vector<const DrawCommand*>& visible, const Rasterizer& rasterizer, VertexProcessor& vertexProcessor, RenderQueueStats& stats);
+
+    /*
+     * every queued mesh casts, shadow maps are rendered again only when a caster or the light moved
+     */
+    void updateShadowMaps(const std::vector<ShadowCaster>& casters, const std::vector<const Light*>& shadowLights, const VertexProcessor& vertexProcessor, RenderQueueStats& stats);
+
+    /*
+     * geometry stage of prepare for draws whose instances were culled, processors hold their object to world
+     * matrices, every job writes its own vertices and its own prepared triangles, drawing reads the triangles
+     * in span order so the result does not depend on the thread count
+     */
+    void processGeometry(std::vector<TransformedInstance>& draws, const std::vector<VertexProcessor>& processors, const Rasterizer& rasterizer);
+
+    void clear();
+
+private:
+    std::vector<DrawCommand> mCommands;
+    std::vector<const void*> mTextures;
+    std::vector<const void*> mLights;
+    RenderQueueStats mStats;
+    bool mDepthPrepass = false;
+    bool mOcclusionCulling = false;
+    OcclusionBuffer mOcclusionBuffer;
+    std::unique_ptr<JobScheduler> mGeometryScheduler;
+    PreparedFrame mFrame;                    // of flush with geometry threads
+};
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "job_scheduler.hpp"
+#include "scene_renderer.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// one renderer per worker, they share the resource cache
+std::vector<std::unique_ptr<SceneRenderer>> createRenderers(ResourceCache& cache, size_t count)
+{
+    std::vector<std::unique_ptr<SceneRenderer>> renderers;
+    for (size_t i = 0; i < count; i++)
+    {
+        renderers.push_back(std::make_unique<SceneRenderer>(cache));
+    }
+    return renderers;
+}
+
+/*
+ * reads "<scene file> [output prefix]" lines and answers "<request> ok <frames> <latency ms>"
+ * or "<request> error <message>" as jobs complete, in completion order
+ */
+int serve(size_t threads)
+{
+    ResourceCache cache;
+    auto renderers = createRenderers(cache, threads);
+    std::mutex outputMutex;
+    JobScheduler scheduler(threads);
+
+    std::string line;
+    size_t request = 0;
+    while (std::getline(std::cin, line))
+    {
+        std::istringstream args(line);
+        std::string scene;
+        if (!(args >> scene))
+        {
+            continue;
+        }
+        if (scene == "quit")
+        {
+            break;
+        }
+        std::string prefix;
+        args >> prefix;
+        const size_t id = request++;
+        const auto submitted = Clock::now();
+        scheduler.submit([&, id, scene, prefix, submitted](size_t worker) {
+            auto& renderer = *renderers[worker];
+            std::string response;
+            try
+            {
+                const size_t framesBefore = renderer.getFrameCount();
+                renderer.setOutputPrefix(prefix);
+                renderer.run(scene);
+                response = "ok " + std::to_string(renderer.getFrameCount() - framesBefore) + " " + std::to_string(elapsedMs(submitted));
+            }
+            catch (const std::exception& e)
+            {
+                response = std::string("error ") + e.what();
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << id << ' ' << response << std::endl;
+        });
+    }
+    scheduler.wait();
+    return 0;
+}
+
+/*
+ * submits every job at once for 1, 2, 4... threads and reports throughput and latency from submission to completion
+ */
+int bench(size_t maxThreads, size_t jobs, const std::vector<std::string>& scenes)
+{
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    ResourceCache cache;
+    for (const size_t threads : threadCounts)
+    {
+        auto renderers = createRenderers(cache, threads);
+        for (size_t worker = 0; worker < threads; worker++)
+        {
+            renderers[worker]->setOutputPrefix("render_server_bench_" + std::to_string(worker) + "_");
+        }
+        std::vector<double> latencies(jobs);
+        std::mutex errorMutex;
+        std::string error;
+        const auto start = Clock::now();
+        {
+            JobScheduler scheduler(threads);
+            for (size_t i = 0; i < jobs; i++)
+            {
+                scheduler.submit([&, i](size_t worker) {
+                    try
+                    {
+                        renderers[worker]->run(scenes[i % scenes.size()]);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        error = e.what();
+                    }
+                    latencies[i] = elapsedMs(start);
+                });
+            }
+            scheduler.wait();
+        }
+        const double totalMs = elapsedMs(start);
+        if (!error.empty())
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&](double p) { return latencies[std::min((size_t)(p * jobs), jobs - 1)]; };
+        std::cout << threads << " threads: " << jobs * 1000.0 / totalMs << " jobs/s, latency p50 " << percentile(0.5) << " ms, p95 "
+                  << percentile(0.95) << " ms, max " << latencies.back() << " ms" << std::endl;
+    }
+    return 0;
+}
+
+}
+
+/*
+ * usage: render_server [--threads N]                       requests on stdin, see serve()
+ *        render_server [--threads N] --bench JOBS scene... load test
+ */
+int main(int argc, char** argv) {
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t jobs = 0;
+    std::vector<std::string> scenes;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            threads = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (arg == "--bench" && i + 1 < argc)
+        {
+            jobs = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (jobs > 0)
+        {
+            scenes.push_back(arg);
+        }
+        else
+        {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (jobs > 0)
+    {
+        if (scenes.empty())
+        {
+            std::cerr << "--bench needs at least one scene" << std::endl;
+            return 2;
+        }
+        return bench(threads, jobs, scenes);
+    }
+    return serve(threads);
+}
@@ -0,0 +1,207 @@
+#include "render_stats.hpp"
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct TraceEvent
+{
+    const char* name;
+    double startUs;
+    double durationUs;
+};
+
+struct ThreadStats
+{
+    RenderStats stats;
+    std::vector<TraceEvent> events;
+    size_t threadId;
+    ProfileScope* scope = nullptr;
+};
+
+std::mutex& registryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// blocks stay alive after their thread exits so late frames and traces still see them
+std::vector<std::shared_ptr<ThreadStats>>& registry()
+{
+    static std::vector<std::shared_ptr<ThreadStats>> threads;
+    return threads;
+}
+
+ThreadStats& threadStats()
+{
+    thread_local std::shared_ptr<ThreadStats> local = [] {
+        // trace timestamps are relative to the first thread that records anything
+        Profiler::epoch();
+        auto stats = std::make_shared<ThreadStats>();
+        std::lock_guard<std::mutex> lock(registryMutex());
+        stats->threadId = registry().size();
+        registry().push_back(stats);
+        return stats;
+    }();
+    return *local;
+}
+
+std::atomic<bool>& traceRecording()
+{
+    static std::atomic<bool> recording{false};
+    return recording;
+}
+
+const char* stageName(int stage)
+{
+    static const char* names[] = {"transform", "setup", "raster", "shade", "writeOut"};
+    return names[stage];
+}
+
+}
+
+RenderStats &RenderStats::operator+=(const RenderStats &other) {
+    for (int i = 0; i < (int)RenderStage::Count; i++)
+    {
+        stageMs[i] += other.stageMs[i];
+    }
+    trianglesSubmitted += other.trianglesSubmitted;
+    trianglesCulled += other.trianglesCulled;
+    trianglesRasterized += other.trianglesRasterized;
+    trianglesRejected += other.trianglesRejected;
+    trianglesSmall += other.trianglesSmall;
+    pixelsTested += other.pixelsTested;
+    pixelsPassed += other.pixelsPassed;
+    pixelsShaded += other.pixelsShaded;
+    textureFetches += other.textureFetches;
+    return *this;
+}
+
+void RenderStats::writeJson(std::ostream &os, size_t frame) const {
+    os << "{\"frame\":" << frame << ",\"stagesMs\":{";
+    for (int i = 0; i < (int)RenderStage::Count; i++)
+    {
+        os << (i ? "," : "") << '"' << stageName(i) << "\":" << stageMs[i];
+    }
+    os << "},\"trianglesSubmitted\":" << trianglesSubmitted
+       << ",\"trianglesCulled\":" << trianglesCulled
+       << ",\"trianglesRasterized\":" << trianglesRasterized
+       << ",\"trianglesRejected\":" << trianglesRejected
+       << ",\"trianglesSmall\":" << trianglesSmall
+       << ",\"pixelsTested\":" << pixelsTested
+       << ",\"pixelsPassed\":" << pixelsPassed
+       << ",\"pixelsShaded\":" << pixelsShaded
+       << ",\"textureFetches\":" << textureFetches
+       << ",\"coveredPixels\":" << coveredPixels
+       << ",\"overdraw\":" << overdraw << "}\n";
+}
+
+RenderStats &Profiler::counters() {
+    return threadStats().stats;
+}
+
+void Profiler::beginFrame() {
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for (auto& thread : registry())
+    {
+        thread->stats = RenderStats();
+    }
+}
+
+RenderStats Profiler::endFrame(size_t coveredPixels) {
+    RenderStats total;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (const auto& thread : registry())
+        {
+            total += thread->stats;
+        }
+    }
+    total.coveredPixels = coveredPixels;
+    total.overdraw = coveredPixels ? (float)total.pixelsPassed / coveredPixels : 0.0f;
+    return total;
+}
+
+void Profiler::writeChromeTrace(const std::string &fname) {
+    std::ofstream of{ fname };
+    if (!of)
+    {
+        throw std::runtime_error("Unable to open the trace file.");
+    }
+    of << "{\"traceEvents\":[";
+    bool first = true;
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for (const auto& thread : registry())
+    {
+        for (const auto& event : thread->events)
+        {
+            of << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread->threadId
+               << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << '}';
+            first = false;
+        }
+    }
+    of << "\n]}\n";
+}
+
+void Profiler::setTraceRecording(bool recording) {
+    traceRecording() = recording;
+}
+
+void Profiler::clearTrace() {
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for (auto& thread : registry())
+    {
+        thread->events.clear();
+    }
+}
+
+void Profiler::addTraceEvent(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    if (!traceRecording().load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    const auto us = [](std::chrono::steady_clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+    threadStats().events.push_back({name, us(start - epoch()), us(end - start)});
+}
+
+std::chrono::steady_clock::time_point Profiler::epoch() {
+    static const auto start = std::chrono::steady_clock::now();
+    return start;
+}
+
+ProfileScope::ProfileScope(RenderStage stage, const char *traceName) : mStage(stage), mTraceName(traceName), mStart(std::chrono::steady_clock::now()) {
+    auto& thread = threadStats();
+    mParent = thread.scope;
+    thread.scope = this;
+}
+
+ProfileScope::ProfileScope(const char *traceName) : ProfileScope(RenderStage::Count, traceName) {
+}
+
+ProfileScope::~ProfileScope() {
+    const auto end = std::chrono::steady_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(end - mStart).count();
+    auto& thread = threadStats();
+    thread.scope = mParent;
+    if (mStage != RenderStage::Count)
+    {
+        thread.stats.stageMs[(int)mStage] += ms - mChildMs;
+        if (mParent)
+        {
+            mParent->mChildMs += ms;
+        }
+    }
+    else if (mParent)
+    {
+        // trace only scopes are transparent to the stage timers
+        mParent->mChildMs += mChildMs;
+    }
+    if (mTraceName)
+    {
+        Profiler::addTraceEvent(mTraceName, mStart, end);
+    }
+}
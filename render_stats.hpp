@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class RenderStage {
+    Transform,                               // vertex transform in Mesh
+    Setup,                                   // Rasterizer::drawTriangle up to fillTriangle
+    Raster,                                  // coverage and depth test in fillTriangle
+    Shade,                                   // interpolation, Light::calculate and pixel writes, timed per batch of pixels
+    WriteOut,                                // encoding the frame to a file
+    Count
+};
+
+struct RenderStats
+{
+    double stageMs[(int)RenderStage::Count] = {};
+    size_t trianglesSubmitted = 0;
+    size_t trianglesCulled = 0;              // by frustum, normal cone or occlusion tests
+    size_t trianglesRasterized = 0;          // covering at least one pixel
+    size_t trianglesRejected = 0;            // by triangle setup: zero area, back facing or outside the scissor
+    size_t trianglesSmall = 0;               // at most 4 candidate pixels
+    size_t pixelsTested = 0;                 // covered pixels reaching the depth test
+    size_t pixelsPassed = 0;
+    size_t pixelsShaded = 0;
+    size_t textureFetches = 0;
+    size_t coveredPixels = 0;                // distinct pixels holding geometry at the end of the frame
+    float overdraw = 0.0f;                   // pixelsPassed / coveredPixels, depth only passes included
+
+    RenderStats& operator+=(const RenderStats& other);
+
+    void writeJson(std::ostream& os, size_t frame) const;
+};
+
+/*
+ * per thread counters and stage timers, every thread records into its own block without locking
+ */
+class Profiler {
+public:
+    static RenderStats& counters();
+
+    static void beginFrame();
+
+    /*
+     * sums every thread, coveredPixels is used for the overdraw ratio
+     */
+    static RenderStats endFrame(size_t coveredPixels);
+
+    /*
+     * Chrome trace event format, open with chrome://tracing or Perfetto
+     */
+    static void writeChromeTrace(const std::string& fname);
+
+    /*
+     * named scopes only become trace events while recording is on, it is off by default so long runs
+     * do not collect events nobody writes out
+     */
+    static void setTraceRecording(bool recording);
+
+    // drops the events recorded so far on every thread
+    static void clearTrace();
+
+    static void addTraceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    static std::chrono::steady_clock::time_point epoch();
+};
+
+/*
+ * times a stage exclusive of nested scopes, named scopes are also recorded as trace events
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(RenderStage stage, const char* traceName = nullptr);
+
+    explicit ProfileScope(const char* traceName);
+
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    RenderStage mStage;
+    const char* mTraceName;
+    std::chrono::steady_clock::time_point mStart;
+    double mChildMs = 0.0;
+    ProfileScope* mParent;
+};
+
+#define RENDER_STATS_CONCAT_INNER(a, b) a##b
+#define RENDER_STATS_CONCAT(a, b) RENDER_STATS_CONCAT_INNER(a, b)
+
+#ifdef RENDER_STATS
+#define RENDER_STATS_COUNT(counter, n) (Profiler::counters().counter += (n))
+#define RENDER_STATS_SCOPE(...) ProfileScope RENDER_STATS_CONCAT(renderStatsScope, __LINE__)(__VA_ARGS__)
+#else
+#define RENDER_STATS_COUNT(counter, n) ((void)0)
+#define RENDER_STATS_SCOPE(...) ((void)0)
+#endif
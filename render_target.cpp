@@ -0,0 +1,305 @@
+#include "render_target.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t alignment = 64;
+
+size_t alignUp(size_t size)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+template <class T>
+T* allocateAligned(size_t bytes)
+{
+    void* memory = std::aligned_alloc(alignment, std::max(alignUp(bytes), alignment));
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<T*>(memory);
+}
+
+size_t bytesPerPixel(ColorFormat format)
+{
+    switch (format)
+    {
+        case ColorFormat::RGBA8:
+            return 4;
+        case ColorFormat::RGBA32F:
+            return 4 * sizeof(float);
+        default:
+            return 0;
+    }
+}
+
+}
+
+RenderTarget::RenderTarget(int width, int height, ColorFormat format, int samples)
+        : mWidth(width), mHeight(height), mFormat(format), mSamples(samples), mAllSamples((1u << samples) - 1),
+          mColorStride(alignUp(width * bytesPerPixel(format))), mDepthStride(alignUp(width * sizeof(float)) / sizeof(float)),
+          mDepthPlane(mDepthStride * height), mTilesX((width + tileSize - 1) / tileSize), mTilesY((height + tileSize - 1) / tileSize) {
+    if (width <= 0 || height <= 0)
+    {
+        throw std::runtime_error("The image width and height must be positive numbers.");
+    }
+    if (samples != 1 && samples != 4 && samples != 8)
+    {
+        throw std::runtime_error("The render target supports 1, 4 or 8 samples per pixel.");
+    }
+    if (format != ColorFormat::None)
+    {
+        mColor.reset(allocateAligned<uint8_t>(mColorStride * height));
+        if (samples > 1)
+        {
+            mSampleColor.reset(allocateAligned<uint8_t>(mColorStride * height * (samples - 1)));
+        }
+        mPending.resize(mTilesX * mTilesY);
+        mCompressed.resize(mTilesX * mTilesY, 1);
+        mClearRow.resize(mColorStride);
+        clearColor(float3{0.0f, 0.0f, 0.0f});
+    }
+    mDepth.reset(allocateAligned<float>(mDepthPlane * samples * sizeof(float)));
+    clearDepth();
+}
+
+int RenderTarget::getWidth() const {
+    return mWidth;
+}
+
+int RenderTarget::getHeight() const {
+    return mHeight;
+}
+
+ColorFormat RenderTarget::getFormat() const {
+    return mFormat;
+}
+
+int RenderTarget::getSamples() const {
+    return mSamples;
+}
+
+float3 RenderTarget::getPixel(int x, int y) const {
+    const int tile = y / tileSize * mTilesX + x / tileSize;
+    const bool pending = mPendingTiles > 0 && mPending[tile];
+    const uint8_t* row = pending ? mClearRow.data() : getColorRow(y);
+    // uncompressed multisample tiles are averaged into a single pixel
+    uint8_t resolved[4 * sizeof(float)];
+    if (!pending && !mCompressed[tile])
+    {
+        averageSamples(y, x, x, resolved);
+        row = resolved - x * bytesPerPixel(mFormat);
+    }
+    if (mFormat == ColorFormat::RGBA8)
+    {
+        const uint8_t* pixel = row + x * 4;
+        return float3{pixel[0] / 255.0f, pixel[1] / 255.0f, pixel[2] / 255.0f};
+    }
+    if (mFormat == ColorFormat::RGBA32F)
+    {
+        const float* pixel = reinterpret_cast<const float*>(row) + x * 4;
+        return float3{pixel[0], pixel[1], pixel[2]};
+    }
+    return float3{0.0f, 0.0f, 0.0f};
+}
+
+const uint8_t *RenderTarget::getColorRow(int y) const {
+    return mColor.get() + y * mColorStride;
+}
+
+const uint8_t *RenderTarget::getResolvedColorRow(int y, uint8_t *scratch) const {
+    if (isRowResolved(y))
+    {
+        return getColorRow(y);
+    }
+    const size_t pixelSize = bytesPerPixel(mFormat);
+    const uint8_t* row = getColorRow(y);
+    const uint8_t* pending = mPending.data() + y / tileSize * mTilesX;
+    const uint8_t* compressed = mCompressed.data() + y / tileSize * mTilesX;
+    for (int tx = 0; tx < mTilesX; tx++)
+    {
+        const int minX = tx * tileSize;
+        const int maxX = std::min((tx + 1) * tileSize, mWidth) - 1;
+        const size_t begin = minX * pixelSize;
+        if (!pending[tx] && !compressed[tx])
+        {
+            averageSamples(y, minX, maxX, scratch + begin);
+            continue;
+        }
+        std::memcpy(scratch + begin, (pending[tx] ? mClearRow.data() : row) + begin, (maxX - minX + 1) * pixelSize);
+    }
+    return scratch;
+}
+
+size_t RenderTarget::getColorRowSize() const {
+    return mColorStride;
+}
+
+void RenderTarget::clearColor(const float3 &color) {
+    if (mFormat == ColorFormat::None)
+    {
+        return;
+    }
+    for (int x = 0; x < mWidth; x++)
+    {
+        storePixel(mClearRow.data(), x, color);
+    }
+    std::fill(mPending.begin(), mPending.end(), 1);
+    mPendingTiles = mPending.size();
+    std::fill(mCompressed.begin(), mCompressed.end(), 1);
+}
+
+void RenderTarget::resolve() {
+    for (int ty = 0; ty < mTilesY && mPendingTiles > 0; ty++)
+    {
+        for (int tx = 0; tx < mTilesX; tx++)
+        {
+            if (mPending[ty * mTilesX + tx])
+            {
+                resolveTile(tx, ty);
+            }
+        }
+    }
+}
+
+size_t RenderTarget::getPendingTiles() const {
+    return mPendingTiles;
+}
+
+void RenderTarget::resolveTile(int tx, int ty) {
+    const size_t pixelSize = bytesPerPixel(mFormat);
+    const size_t begin = tx * tileSize * pixelSize;
+    const size_t size = (std::min((tx + 1) * tileSize, mWidth) - tx * tileSize) * pixelSize;
+    const int endY = std::min((ty + 1) * tileSize, mHeight);
+    for (int y = ty * tileSize; y < endY; y++)
+    {
+        std::memcpy(mColor.get() + y * mColorStride + begin, mClearRow.data() + begin, size);
+    }
+    mPending[ty * mTilesX + tx] = 0;
+    mPendingTiles--;
+    mCompressed[ty * mTilesX + tx] = 1;
+}
+
+void RenderTarget::decompressTile(int tile) {
+    const size_t pixelSize = bytesPerPixel(mFormat);
+    const int tx = tile % mTilesX;
+    const int ty = tile / mTilesX;
+    const size_t begin = tx * tileSize * pixelSize;
+    const size_t size = (std::min((tx + 1) * tileSize, mWidth) - tx * tileSize) * pixelSize;
+    const int endY = std::min((ty + 1) * tileSize, mHeight);
+    for (int s = 1; s < mSamples; s++)
+    {
+        for (int y = ty * tileSize; y < endY; y++)
+        {
+            std::memcpy(sampleRow(s, y) + begin, sampleRow(0, y) + begin, size);
+        }
+    }
+    mCompressed[tile] = 0;
+}
+
+void RenderTarget::averageSamples(int y, int minX, int maxX, uint8_t *out) const {
+    if (mFormat == ColorFormat::RGBA8)
+    {
+        for (int i = 0; i < (maxX - minX + 1) * 4; i++)
+        {
+            unsigned sum = mSamples / 2;
+            for (int s = 0; s < mSamples; s++)
+            {
+                sum += sampleRow(s, y)[minX * 4 + i];
+            }
+            out[i] = sum / mSamples;
+        }
+    }
+    else if (mFormat == ColorFormat::RGBA32F)
+    {
+        float* result = reinterpret_cast<float*>(out);
+        for (int i = 0; i < (maxX - minX + 1) * 4; i++)
+        {
+            float sum = 0.0f;
+            for (int s = 0; s < mSamples; s++)
+            {
+                sum += reinterpret_cast<const float*>(sampleRow(s, y))[minX * 4 + i];
+            }
+            result[i] = sum / mSamples;
+        }
+    }
+}
+
+bool RenderTarget::isRowResolved(int y) const {
+    const auto pending = mPending.begin() + y / tileSize * mTilesX;
+    const auto compressed = mCompressed.begin() + y / tileSize * mTilesX;
+    return (mPendingTiles == 0 || std::find(pending, pending + mTilesX, 1) == pending + mTilesX)
+           && (mSamples == 1 || std::find(compressed, compressed + mTilesX, 0) == compressed + mTilesX);
+}
+
+void RenderTarget::clearDepth(float value) {
+    // rows and sample planes are contiguous including their padding, a single fill
+    std::fill(mDepth.get(), mDepth.get() + mDepthPlane * mSamples, value);
+}
+
+void RenderTarget::clearRegion(const PixelRect &rect, float depth) {
+    const PixelRect clipped{std::max(rect.minX, 0), std::max(rect.minY, 0), std::min(rect.maxX, mWidth - 1), std::min(rect.maxY, mHeight - 1)};
+    if (clipped.isEmpty())
+    {
+        return;
+    }
+    for (int s = 0; s < mSamples; s++)
+    {
+        for (int y = clipped.minY; y <= clipped.maxY; y++)
+        {
+            float* row = mDepth.get() + s * mDepthPlane + y * mDepthStride;
+            std::fill(row + clipped.minX, row + clipped.maxX + 1, depth);
+        }
+    }
+    if (mFormat == ColorFormat::None)
+    {
+        return;
+    }
+    const size_t pixelSize = bytesPerPixel(mFormat);
+    for (int ty = clipped.minY / tileSize; ty <= clipped.maxY / tileSize; ty++)
+    {
+        for (int tx = clipped.minX / tileSize; tx <= clipped.maxX / tileSize; tx++)
+        {
+            auto& pending = mPending[ty * mTilesX + tx];
+            if (pending)
+            {
+                continue;
+            }
+            const PixelRect tile{tx * tileSize, ty * tileSize, std::min((tx + 1) * tileSize, mWidth) - 1, std::min((ty + 1) * tileSize, mHeight) - 1};
+            if (clipped.minX <= tile.minX && clipped.minY <= tile.minY && clipped.maxX >= tile.maxX && clipped.maxY >= tile.maxY)
+            {
+                pending = 1;
+                mPendingTiles++;
+                mCompressed[ty * mTilesX + tx] = 1;
+                continue;
+            }
+            const int minX = std::max(clipped.minX, tile.minX);
+            const int maxX = std::min(clipped.maxX, tile.maxX);
+            const int samples = mCompressed[ty * mTilesX + tx] ? 1 : mSamples;
+            for (int s = 0; s < samples; s++)
+            {
+                for (int y = std::max(clipped.minY, tile.minY); y <= std::min(clipped.maxY, tile.maxY); y++)
+                {
+                    std::memcpy(sampleRow(s, y) + minX * pixelSize, mClearRow.data() + minX * pixelSize, (maxX - minX + 1) * pixelSize);
+                }
+            }
+        }
+    }
+}
+
+PixelRect RenderTarget::getRect() const {
+    return PixelRect{0, 0, mWidth - 1, mHeight - 1};
+}
+
+size_t RenderTarget::getCoveredPixels(float clearValue) const {
+    size_t count = 0;
+    for (int y = 0; y < mHeight; y++)
+    {
+        const float* row = mDepth.get() + y * mDepthStride;
+        count += std::count_if(row, row + mWidth, [clearValue](float depth) { return depth < clearValue; });
+    }
+    return count;
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include "vector.hpp"
+
+enum class ColorFormat {
+    RGBA8,                                   // 4 bytes per pixel, R first
+    RGBA32F,                                 // 4 floats per pixel, values are not clamped
+    None                                     // depth only target
+};
+
+/*
+ * inclusive pixel rectangle, empty when min exceeds max
+ */
+struct PixelRect
+{
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+
+    bool isEmpty() const {
+        return minX > maxX || minY > maxY;
+    }
+
+    bool overlaps(const PixelRect& other) const {
+        return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY && other.minY <= maxY;
+    }
+};
+
+/*
+ * color and depth surfaces drawn by the rasterizer, rows go from the top of the view down,
+ * every row starts 64 byte aligned, file layouts are produced by the image encoders
+ *
+ * clearing color only marks tiles, a tile is filled with the clear color when it is first drawn to
+ * and tiles never drawn are filled in while reading rows for output
+ *
+ * with 4 or 8 samples depth is kept per sample, color of sample 0 lives in the regular surface and the other
+ * samples in planes that a tile only writes after a triangle edge crossed it, until then every sample of the
+ * tile equals sample 0, the samples are averaged while reading rows for output
+ */
+class RenderTarget {
+public:
+    static constexpr int tileSize = 32;
+
+    RenderTarget(int width, int height, ColorFormat format = ColorFormat::RGBA8, int samples = 1);
+
+    int getWidth() const;
+
+    int getHeight() const;
+
+    ColorFormat getFormat() const;
+
+    int getSamples() const;
+
+    /*
+     * the tile holding the pixel must be resolved, see resolveRegion
+     */
+    void setPixel(int x, int y, const float3& color) {
+        storePixel(mColor.get() + y * mColorStride, x, color);
+    }
+
+    /*
+     * writes the samples set in the mask, the tile holding the pixel must be resolved
+     */
+    void setSamples(int x, int y, unsigned mask, const float3& color) {
+        const int tile = y / tileSize * mTilesX + x / tileSize;
+        if (mCompressed[tile])
+        {
+            if (mask == mAllSamples)
+            {
+                setPixel(x, y, color);
+                return;
+            }
+            decompressTile(tile);
+        }
+        for (int s = 0; s < mSamples; s++)
+        {
+            if (mask & (1u << s))
+            {
+                storePixel(sampleRow(s, y), x, color);
+            }
+        }
+    }
+
+    /*
+     * resolved color
+     */
+    float3 getPixel(int x, int y) const;
+
+    float& depth(int x, int y) {
+        return mDepth[y * mDepthStride + x];
+    }
+
+    float depth(int x, int y) const {
+        return mDepth[y * mDepthStride + x];
+    }
+
+    float& sampleDepth(int x, int y, int sample) {
+        return mDepth[sample * mDepthPlane + y * mDepthStride + x];
+    }
+
+    float sampleDepth(int x, int y, int sample) const {
+        return mDepth[sample * mDepthPlane + y * mDepthStride + x];
+    }
+
+    /*
+     * RGBA8 bytes or RGBA32F floats of one row of sample 0 as stored, tiles still pending a clear hold stale data
+     */
+    const uint8_t* getColorRow(int y) const;
+
+    /*
+     * the row with pending tiles filled with the clear color and samples averaged, either the stored row
+     * or scratch, which needs getColorRowSize() bytes
+     */
+    const uint8_t* getResolvedColorRow(int y, uint8_t* scratch) const;
+
+    size_t getColorRowSize() const;
+
+    /*
+     * fast clear, marks every tile as pending without touching the color surface
+     */
+    void clearColor(const float3& color);
+
+    /*
+     * writes the clear color into pending tiles overlapping the inclusive pixel rectangle
+     */
+    void resolveRegion(int minx, int miny, int maxx, int maxy) {
+        if (mPendingTiles == 0 || minx > maxx || miny > maxy)
+        {
+            return;
+        }
+        for (int ty = miny / tileSize; ty <= maxy / tileSize; ty++)
+        {
+            for (int tx = minx / tileSize; tx <= maxx / tileSize; tx++)
+            {
+                if (mPending[ty * mTilesX + tx])
+                {
+                    resolveTile(tx, ty);
+                }
+            }
+        }
+    }
+
+    /*
+     * fills every pending tile, only needed before reading getColorRow directly
+     */
+    void resolve();
+
+    size_t getPendingTiles() const;
+
+    void clearDepth(float value = 1.0f);
+
+    /*
+     * clears color to the last clear color and depth to the value inside the rectangle,
+     * whole tiles are only marked as pending
+     */
+    void clearRegion(const PixelRect& rect, float depth = 1.0f);
+
+    PixelRect getRect() const;
+
+    /*
+     * pixels holding geometry nearer than the clear value
+     */
+    size_t getCoveredPixels(float clearValue = 1.0f) const;
+
+private:
+    void storePixel(uint8_t* row, int x, const float3& color) const {
+        if (mFormat == ColorFormat::RGBA8)
+        {
+            uint8_t* pixel = row + x * 4;
+            pixel[0] = (int)(color.r() * 255);
+            pixel[1] = (int)(color.g() * 255);
+            pixel[2] = (int)(color.b() * 255);
+            pixel[3] = 255;
+        }
+        else if (mFormat == ColorFormat::RGBA32F)
+        {
+            float* pixel = reinterpret_cast<float*>(row) + x * 4;
+            pixel[0] = color.r();
+            pixel[1] = color.g();
+            pixel[2] = color.b();
+            pixel[3] = 1.0f;
+        }
+    }
+
+    uint8_t* sampleRow(int sample, int y) {
+        return sample == 0 ? mColor.get() + y * mColorStride : mSampleColor.get() + ((sample - 1) * mHeight + y) * mColorStride;
+    }
+
+    const uint8_t* sampleRow(int sample, int y) const {
+        return sample == 0 ? mColor.get() + y * mColorStride : mSampleColor.get() + ((sample - 1) * mHeight + y) * mColorStride;
+    }
+
+    void resolveTile(int tx, int ty);
+
+    // copies sample 0 of the tile to the other samples
+    void decompressTile(int tile);
+
+    void averageSamples(int y, int minX, int maxX, uint8_t* out) const;
+
+    bool isRowResolved(int y) const;
+
+private:
+    struct AlignedDeleter
+    {
+        void operator()(void* p) const { std::free(p); }
+    };
+
+private:
+    int mWidth;
+    int mHeight;
+    ColorFormat mFormat;
+    int mSamples;
+    unsigned mAllSamples;
+    size_t mColorStride;                     // bytes
+    size_t mDepthStride;                     // floats
+    size_t mDepthPlane;                      // floats of one sample
+    std::unique_ptr<uint8_t[], AlignedDeleter> mColor;
+    std::unique_ptr<uint8_t[], AlignedDeleter> mSampleColor;   // samples 1 and up, pages of compressed tiles stay untouched
+    std::unique_ptr<float[], AlignedDeleter> mDepth;
+    int mTilesX;
+    int mTilesY;
+    std::vector<uint8_t> mPending;           // per tile, 1 while it still needs the clear color
+    size_t mPendingTiles = 0;
+    std::vector<uint8_t> mCompressed;        // per tile, 1 while every sample equals sample 0, always 1 for one sample
+    std::vector<uint8_t> mClearRow;          // one row of the clear color, source of every resolve
+
+};
@@ -0,0 +1,67 @@
+#include "resource_cache.hpp"
+#include "mesh_io.hpp"
+#include "sphere.hpp"
+#include "cone.hpp"
+
+std::shared_ptr<BMP> ResourceCache::getTexture(const std::string &fname) {
+    // loads happen under the lock, concurrent requests for one file must not load it twice
+    std::lock_guard<std::mutex> lock(mMutex);
+    const auto found = mTextures.find(fname);
+    if (found != mTextures.end())
+    {
+        mHits++;
+        return found->second;
+    }
+    mMisses++;
+    auto texture = std::make_shared<BMP>(fname.c_str(), mTextureProcessor);
+    mTextures.emplace(fname, texture);
+    return texture;
+}
+
+template <class F>
+SceneMesh ResourceCache::getMesh(const std::string &key, F &&create) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    const auto found = mMeshes.find(key);
+    if (found != mMeshes.end())
+    {
+        mHits++;
+        return found->second;
+    }
+    mMisses++;
+    SceneMesh mesh = create();
+    mMeshes.emplace(key, mesh);
+    return mesh;
+}
+
+SceneMesh ResourceCache::getMeshFile(const std::string &fname, VertexFormat format) {
+    return getMesh("file " + fname + " " + std::to_string((int)format), [&] {
+        auto mesh = loadMesh(fname);
+        mesh->setVertexFormat(format);
+        mesh->prepare();
+        return SceneMesh{mesh, nullptr};
+    });
+}
+
+SceneMesh ResourceCache::getSphere(float radius) {
+    return getMesh("sphere " + std::to_string(radius), [&] {
+        Vertex center;
+        return SceneMesh{nullptr, std::make_shared<LodMesh>(Sphere::createLod(center, radius))};
+    });
+}
+
+SceneMesh ResourceCache::getCone(float radius, float height) {
+    return getMesh("cone " + std::to_string(radius) + " " + std::to_string(height), [&] {
+        Vertex center;
+        return SceneMesh{nullptr, std::make_shared<LodMesh>(Cone::createLod(radius, height, center))};
+    });
+}
+
+size_t ResourceCache::getHits() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHits;
+}
+
+size_t ResourceCache::getMisses() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMisses;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "BMP.h"
+#include "mesh.hpp"
+#include "lod_mesh.hpp"
+
+/*
+ * mesh used by a scene, procedural shapes come as LOD chains
+ */
+struct SceneMesh
+{
+    std::shared_ptr<Mesh> mesh;
+    std::shared_ptr<LodMesh> lod;
+};
+
+/*
+ * textures and meshes loaded once and shared by every scene rendered in the process,
+ * safe to use from several threads, returned resources are prepared and never modified
+ */
+class ResourceCache {
+public:
+    std::shared_ptr<BMP> getTexture(const std::string& fname);
+
+    SceneMesh getMeshFile(const std::string& fname, VertexFormat format = VertexFormat::Full);
+
+    SceneMesh getSphere(float radius);
+
+    SceneMesh getCone(float radius, float height);
+
+    size_t getHits() const;
+
+    size_t getMisses() const;
+
+private:
+    template <class F>
+    SceneMesh getMesh(const std::string& key, F&& create);
+
+private:
+    // textures only sample their pixels, the processor they keep a reference to is never used
+    VertexProcessor mTextureProcessor;
+    std::map<std::string, std::shared_ptr<BMP>> mTextures;
+    std::map<std::string, SceneMesh> mMeshes;
+    mutable std::mutex mMutex;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+};
@@ -0,0 +1,176 @@
+#include "retained_scene.hpp"
+#include <algorithm>
+#include "render_stats.hpp"
+
+namespace {
+
+const PixelRect emptyRect{0, 0, -1, -1};
+
+PixelRect unite(const PixelRect& a, const PixelRect& b)
+{
+    return PixelRect{std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY)};
+}
+
+// grows the rectangle to whole tiles of the target
+PixelRect snapToTiles(const PixelRect& rect, const RenderTarget& target)
+{
+    constexpr int tile = RenderTarget::tileSize;
+    return PixelRect{rect.minX / tile * tile, rect.minY / tile * tile, std::min((rect.maxX / tile + 1) * tile - 1, target.getWidth() - 1),
+                     std::min((rect.maxY / tile + 1) * tile - 1, target.getHeight() - 1)};
+}
+
+}
+
+RetainedScene::Handle RetainedScene::add(Mesh &mesh, const MeshInstance &instance) {
+    return add(&mesh, nullptr, instance);
+}
+
+RetainedScene::Handle RetainedScene::add(LodMesh &mesh, const MeshInstance &instance) {
+    return add(nullptr, &mesh, instance);
+}
+
+RetainedScene::Handle RetainedScene::add(Mesh *mesh, LodMesh *lod, const MeshInstance &instance) {
+    mEntries.push_back({mesh, lod, instance, emptyRect, true, true});
+    return mEntries.size() - 1;
+}
+
+void RetainedScene::update(Handle handle, const MeshInstance &instance) {
+    auto& entry = mEntries.at(handle);
+    entry.instance = instance;
+    entry.changed = true;
+}
+
+void RetainedScene::remove(Handle handle) {
+    auto& entry = mEntries.at(handle);
+    entry.alive = false;
+    entry.changed = true;
+}
+
+void RetainedScene::invalidate() {
+    mInvalid = true;
+}
+
+void RetainedScene::setClearColor(const float3 &color) {
+    mClearColor = color;
+    mInvalid = true;
+}
+
+void RetainedScene::render(RenderQueue &queue, Rasterizer &rasterizer, RenderTarget &target, VertexProcessor &vertexProcessor) {
+    RENDER_STATS_SCOPE("RetainedScene::render");
+    mStats = RetainedSceneStats();
+    const float4x4 previousObj2World = vertexProcessor.getObj2World();
+
+    bool shadowed = false;
+    bool changed = false;
+    std::vector<PixelRect> dirty;
+    for (auto& entry : mEntries)
+    {
+        if (entry.alive && entry.instance.light && entry.instance.light->getShadowMap())
+        {
+            shadowed = true;
+        }
+        if (!entry.changed && !mInvalid)
+        {
+            continue;
+        }
+        changed = true;
+        // the old footprint has to be uncovered, the new one drawn
+        if (!entry.bounds.isEmpty())
+        {
+            dirty.push_back(entry.bounds);
+        }
+        entry.bounds = entry.alive ? computeBounds(entry, rasterizer, vertexProcessor) : emptyRect;
+        if (!entry.bounds.isEmpty())
+        {
+            dirty.push_back(entry.bounds);
+        }
+        entry.changed = false;
+    }
+    vertexProcessor.setObj2World(previousObj2World);
+
+    if (mInvalid || (changed && shadowed))
+    {
+        target.clearColor(mClearColor);
+        target.clearDepth();
+        submitAll(queue);
+        queue.flush(rasterizer, vertexProcessor);
+        mStats.fullRedraw = true;
+        mStats.regions = 1;
+        mStats.redrawnPixels = (size_t)target.getWidth() * target.getHeight();
+        mInvalid = false;
+        return;
+    }
+
+    for (auto& rect : dirty)
+    {
+        rect = snapToTiles(rect, target);
+    }
+    // overlapping regions would draw the same pixels twice, a grown region can reach earlier ones again
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < dirty.size(); i++)
+        {
+            for (size_t j = i + 1; j < dirty.size(); j++)
+            {
+                if (dirty[i].overlaps(dirty[j]))
+                {
+                    dirty[i] = unite(dirty[i], dirty[j]);
+                    dirty.erase(dirty.begin() + j);
+                    j = i;
+                    merged = true;
+                }
+            }
+        }
+    }
+    for (const auto& region : dirty)
+    {
+        target.clearRegion(region);
+        rasterizer.setScissor(region);
+        submitAll(queue);
+        queue.flush(rasterizer, vertexProcessor);
+        mStats.regions++;
+        mStats.redrawnPixels += (size_t)(region.maxX - region.minX + 1) * (region.maxY - region.minY + 1);
+    }
+    rasterizer.resetScissor();
+}
+
+const RetainedSceneStats &RetainedScene::getStats() const {
+    return mStats;
+}
+
+PixelRect RetainedScene::computeBounds(Entry &entry, const Rasterizer &rasterizer, VertexProcessor &vertexProcessor) const {
+    vertexProcessor.setObj2World(entry.instance.transform);
+    Mesh& mesh = entry.lod ? entry.lod->selectLevel(rasterizer, vertexProcessor) : *entry.mesh;
+    mesh.prepare();
+    if (!vertexProcessor.isSphereVisible(mesh.getBoundingCenter(), mesh.getBoundingRadius()))
+    {
+        return emptyRect;
+    }
+    ScreenBounds bounds;
+    if (!vertexProcessor.projectSphere(mesh.getBoundingCenter(), mesh.getBoundingRadius(), bounds))
+    {
+        // crosses the near plane, assume it covers everything
+        return PixelRect{0, 0, rasterizer.getWidth() - 1, rasterizer.getHeight() - 1};
+    }
+    return rasterizer.getPixelBounds(bounds);
+}
+
+void RetainedScene::submitAll(RenderQueue &queue) const {
+    for (const auto& entry : mEntries)
+    {
+        if (!entry.alive)
+        {
+            continue;
+        }
+        if (entry.lod)
+        {
+            queue.submit(*entry.lod, entry.instance);
+        }
+        else
+        {
+            queue.submit(*entry.mesh, entry.instance);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include "lod_mesh.hpp"
+#include "mesh.hpp"
+#include "render_queue.hpp"
+#include "render_target.hpp"
+
+struct RetainedSceneStats
+{
+    size_t regions = 0;
+    size_t redrawnPixels = 0;
+    bool fullRedraw = false;
+};
+
+/*
+ * draws kept between frames, a frame clears and draws again only the tiles under the previous
+ * and current bounds of draws that changed, everything else keeps the pixels of the last frame
+ *
+ * the bounds depend on the camera and the shading on the lights, call invalidate() after changing them,
+ * a change while any light casts shadows redraws everything since the shadow can fall anywhere
+ */
+class RetainedScene {
+public:
+    using Handle = size_t;
+
+    Handle add(Mesh& mesh, const MeshInstance& instance);
+
+    Handle add(LodMesh& mesh, const MeshInstance& instance);
+
+    void update(Handle handle, const MeshInstance& instance);
+
+    void remove(Handle handle);
+
+    void invalidate();
+
+    void setClearColor(const float3& color);
+
+    /*
+     * brings the target up to date, the rasterizer has to draw into the target
+     */
+    void render(RenderQueue& queue, Rasterizer& rasterizer, RenderTarget& target, VertexProcessor& vertexProcessor);
+
+    const RetainedSceneStats& getStats() const;
+
+private:
+    struct Entry
+    {
+        Mesh* mesh;
+        LodMesh* lod;
+        MeshInstance instance;
+        PixelRect bounds;                    // where it was drawn by the last frame, empty before
+        bool alive;
+        bool changed;
+    };
+
+    Handle add(Mesh* mesh, LodMesh* lod, const MeshInstance& instance);
+
+    PixelRect computeBounds(Entry& entry, const Rasterizer& rasterizer, VertexProcessor& vertexProcessor) const;
+
+    void submitAll(RenderQueue& queue) const;
+
+private:
+    std::vector<Entry> mEntries;
+    float3 mClearColor{0.0f, 0.0f, 0.0f};
+    bool mInvalid = true;
+    RetainedSceneStats mStats;
+};
@@ -0,0 +1,337 @@
+#include "scene_renderer.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "directional_light.hpp"
+#include "image_encoder.hpp"
+#include "point_light.hpp"
+#include "shadow_map.hpp"
+
+namespace {
+
+template <class T>
+T read(std::istream& is, const char* what)
+{
+    T value;
+    if (!(is >> value))
+    {
+        throw std::runtime_error(std::string("expected ") + what);
+    }
+    return value;
+}
+
+float3 readFloat3(std::istream& is, const char* what)
+{
+    const float x = read<float>(is, what);
+    const float y = read<float>(is, what);
+    const float z = read<float>(is, what);
+    return float3{x, y, z};
+}
+
+template <class T>
+const T& lookup(const std::map<std::string, T>& items, const std::string& name, const char* what)
+{
+    const auto found = items.find(name);
+    if (found == items.end())
+    {
+        throw std::runtime_error(std::string("unknown ") + what + " " + name);
+    }
+    return found->second;
+}
+
+}
+
+SceneRenderer::SceneRenderer(ResourceCache &cache) : mCache(cache) {
+}
+
+void SceneRenderer::run(const std::string &fname) {
+    std::ifstream in{ fname };
+    if (!in)
+    {
+        throw std::runtime_error("Unable to open the scene file " + fname);
+    }
+    run(in, fname);
+}
+
+void SceneRenderer::run(std::istream &is, const std::string &name) {
+    mWidth = 400;
+    mHeight = 400;
+    mCameraSettings = Camera();
+    mDepthPrepass = false;
+    mSamples = 1;
+    mShadingRate = ShadingRate::Rate1x1;
+    mTextures.clear();
+    mMeshes.clear();
+    mLights.clear();
+    mInstances.clear();
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(is, line); lineNumber++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream args(line);
+        std::string command;
+        if (!(args >> command))
+        {
+            continue;
+        }
+        try
+        {
+            execute(command, args);
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error(name + ":" + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+}
+
+void SceneRenderer::execute(const std::string &command, std::istream &args) {
+    if (command == "resolution")
+    {
+        mWidth = read<int>(args, "width");
+        mHeight = read<int>(args, "height");
+    }
+    else if (command == "perspective")
+    {
+        mCameraSettings.fovy = read<float>(args, "field of view");
+        mCameraSettings.near = read<float>(args, "near plane");
+        mCameraSettings.far = read<float>(args, "far plane");
+    }
+    else if (command == "lookat")
+    {
+        mCameraSettings.lookAt = true;
+        mCameraSettings.eye = readFloat3(args, "eye");
+        mCameraSettings.center = readFloat3(args, "center");
+        mCameraSettings.up = readFloat3(args, "up");
+    }
+    else if (command == "texture")
+    {
+        const auto name = read<std::string>(args, "texture name");
+        mTextures[name] = mCache.getTexture(read<std::string>(args, "texture file"));
+    }
+    else if (command == "mesh")
+    {
+        const auto name = read<std::string>(args, "mesh name");
+        const auto kind = read<std::string>(args, "mesh kind");
+        if (kind == "sphere")
+        {
+            mMeshes[name] = mCache.getSphere(read<float>(args, "radius"));
+        }
+        else if (kind == "cone")
+        {
+            const float radius = read<float>(args, "radius");
+            mMeshes[name] = mCache.getCone(radius, read<float>(args, "height"));
+        }
+        else if (kind == "file")
+        {
+            const auto file = read<std::string>(args, "mesh file");
+            auto format = VertexFormat::Full;
+            std::string option;
+            if (args >> option)
+            {
+                if (option == "packed")
+                {
+                    format = VertexFormat::Packed;
+                }
+                else if (option == "half")
+                {
+                    format = VertexFormat::PackedHalfPosition;
+                }
+                else
+                {
+                    throw std::runtime_error("unknown vertex format " + option);
+                }
+            }
+            mMeshes[name] = mCache.getMeshFile(file, format);
+        }
+        else
+        {
+            throw std::runtime_error("unknown mesh kind " + kind);
+        }
+    }
+    else if (command == "light")
+    {
+        const auto name = read<std::string>(args, "light name");
+        const auto kind = read<std::string>(args, "light kind");
+        const float3 position = readFloat3(args, "position");
+        const float3 ambient = readFloat3(args, "ambient");
+        const float3 diffuse = readFloat3(args, "diffuse");
+        const float3 specular = readFloat3(args, "specular");
+        const float shininess = read<float>(args, "shininess");
+        std::shared_ptr<Light> light;
+        if (kind == "point")
+        {
+            light = std::make_shared<PointLight>(position, ambient, diffuse, specular, shininess);
+        }
+        else if (kind == "directional")
+        {
+            light = std::make_shared<DirectionalLight>(position, ambient, diffuse, specular, shininess);
+        }
+        else
+        {
+            throw std::runtime_error("unknown light kind " + kind);
+        }
+        std::string option;
+        while (args >> option)
+        {
+            if (option == "shadow")
+            {
+                light->setShadowMap(std::make_shared<ShadowMap>(read<int>(args, "shadow map size")));
+            }
+            else if (option == "fast")
+            {
+                light->setQuality(LightingQuality::Fast);
+            }
+            else
+            {
+                throw std::runtime_error("unknown light option " + option);
+            }
+        }
+        mLights[name] = light;
+    }
+    else if (command == "instance")
+    {
+        SceneInstance instance;
+        instance.mesh = lookup(mMeshes, read<std::string>(args, "mesh name"), "mesh");
+        const auto texture = read<std::string>(args, "texture name");
+        if (texture != "-")
+        {
+            instance.instance.texture = lookup(mTextures, texture, "texture");
+        }
+        const auto light = read<std::string>(args, "light name");
+        if (light != "-")
+        {
+            instance.instance.light = lookup(mLights, light, "light").get();
+        }
+        // transforms apply in the order they are listed
+        std::string op;
+        while (args >> op)
+        {
+            if (op == "translate")
+            {
+                instance.instance.transform = VertexProcessor::translation(readFloat3(args, "translation")) * instance.instance.transform;
+            }
+            else if (op == "scale")
+            {
+                instance.instance.transform = VertexProcessor::scale(readFloat3(args, "scale")) * instance.instance.transform;
+            }
+            else if (op == "rotate")
+            {
+                const float angle = read<float>(args, "angle");
+                instance.instance.transform = VertexProcessor::rotation(angle, readFloat3(args, "axis")) * instance.instance.transform;
+            }
+            else if (op == "occluder")
+            {
+                instance.instance.occluder = true;
+            }
+            else
+            {
+                throw std::runtime_error("unknown transform " + op);
+            }
+        }
+        mInstances.push_back(instance);
+    }
+    else if (command == "prepass")
+    {
+        const auto mode = read<std::string>(args, "on or off");
+        if (mode != "on" && mode != "off")
+        {
+            throw std::runtime_error("expected on or off");
+        }
+        mDepthPrepass = mode == "on";
+    }
+    else if (command == "occlusion")
+    {
+        const auto mode = read<std::string>(args, "on or off");
+        if (mode != "on" && mode != "off")
+        {
+            throw std::runtime_error("expected on or off");
+        }
+        mOcclusionCulling = mode == "on";
+    }
+    else if (command == "multisample")
+    {
+        const int samples = read<int>(args, "sample count");
+        if (samples != 1 && samples != 4 && samples != 8)
+        {
+            throw std::runtime_error("expected 1, 4 or 8 samples");
+        }
+        mSamples = samples;
+    }
+    else if (command == "shadingrate")
+    {
+        const auto rate = read<std::string>(args, "shading rate");
+        const std::map<std::string, ShadingRate> rates{{"1x1", ShadingRate::Rate1x1}, {"2x2", ShadingRate::Rate2x2},
+                                                       {"4x4", ShadingRate::Rate4x4}, {"adaptive", ShadingRate::Adaptive}};
+        mShadingRate = lookup(rates, rate, "shading rate");
+    }
+    else if (command == "geometrythreads")
+    {
+        const int threads = read<int>(args, "thread count");
+        if (threads < 1)
+        {
+            throw std::runtime_error("expected at least 1 thread");
+        }
+        mGeometryThreads = threads;
+    }
+    else if (command == "frame")
+    {
+        renderFrame(read<std::string>(args, "output file"));
+    }
+    else
+    {
+        throw std::runtime_error("unknown command " + command);
+    }
+}
+
+SceneRenderer::Target &SceneRenderer::target(int width, int height, int samples) {
+    auto& target = mTargets[std::make_tuple(width, height, samples)];
+    if (!target.buffer)
+    {
+        target.buffer = std::make_unique<RenderTarget>(width, height, ColorFormat::RGBA8, samples);
+        target.rasterizer = std::make_unique<Rasterizer>(*target.buffer, mCamera);
+    }
+    return target;
+}
+
+void SceneRenderer::renderFrame(const std::string &output) {
+    // the rasterizers keep a reference to mCamera, so it is reset in place
+    mCamera = VertexProcessor();
+    mCamera.setPerspective(mCameraSettings.fovy, (float)mWidth / mHeight, mCameraSettings.near, mCameraSettings.far);
+    if (mCameraSettings.lookAt)
+    {
+        mCamera.setLookAt(mCameraSettings.eye, mCameraSettings.center, mCameraSettings.up);
+    }
+
+    auto& frame = target(mWidth, mHeight, mSamples);
+    frame.buffer->clearColor({0.0f, 0.0f, 0.0f});
+    frame.buffer->clearDepth();
+    for (const auto& instance : mInstances)
+    {
+        if (instance.mesh.lod)
+        {
+            mQueue.submit(*instance.mesh.lod, instance.instance);
+        }
+        else
+        {
+            mQueue.submit(*instance.mesh.mesh, instance.instance);
+        }
+    }
+    mQueue.setDepthPrepass(mDepthPrepass);
+    mQueue.setOcclusionCulling(mOcclusionCulling);
+    mQueue.setGeometryThreads(mGeometryThreads);
+    frame.rasterizer->setShadingRate(mShadingRate);
+    mQueue.flush(*frame.rasterizer, mCamera);
+    writeImage(*frame.buffer, mOutputPrefix + output);
+    mInstances.clear();
+    mFrameCount++;
+}
+
+size_t SceneRenderer::getFrameCount() const {
+    return mFrameCount;
+}
+
+void SceneRenderer::setOutputPrefix(const std::string &prefix) {
+    mOutputPrefix = prefix;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "render_queue.hpp"
+#include "render_target.hpp"
+#include "resource_cache.hpp"
+
+/*
+ * executes scene description files, one command per line, '#' starts a comment:
+ *
+ *   resolution W H
+ *   perspective FOVY NEAR FAR
+ *   lookat EX EY EZ CX CY CZ UX UY UZ
+ *   texture NAME FILE
+ *   mesh NAME sphere RADIUS | cone RADIUS HEIGHT | file FILE [packed|half]
+ *   light NAME point|directional X Y Z AR AG AB DR DG DB SR SG SB SHININESS [shadow SIZE] [fast]
+ *   instance MESH TEXTURE|- LIGHT|- [translate X Y Z] [rotate ANGLE X Y Z] [scale X Y Z]... [occluder]
+ *   prepass on|off
+ *   occlusion on|off
+ *   multisample 1|4|8
+ *   shadingrate 1x1|2x2|4x4|adaptive
+ *   geometrythreads N
+ *   frame OUTPUT.bmp|.ppm|.raw
+ *
+ * frame renders the instances listed since the previous frame, every other setting carries over,
+ * framebuffers are kept per resolution and sample count and reused by later frames and files
+ *
+ * a renderer owns its camera, framebuffers and lights, one renderer per thread can share the resource cache
+ */
+class SceneRenderer {
+public:
+    explicit SceneRenderer(ResourceCache& cache);
+
+    void run(const std::string& fname);
+
+    void run(std::istream& is, const std::string& name);
+
+    size_t getFrameCount() const;
+
+    /*
+     * prepended to the output file of every frame
+     */
+    void setOutputPrefix(const std::string& prefix);
+
+private:
+    struct Target
+    {
+        std::unique_ptr<RenderTarget> buffer;
+        std::unique_ptr<Rasterizer> rasterizer;
+    };
+
+    struct Camera
+    {
+        float fovy = 90.0f;
+        float near = 0.5f;
+        float far = 100.0f;
+        bool lookAt = false;
+        float3 eye{0.0f, 0.0f, 0.0f};
+        float3 center{0.0f, 0.0f, -1.0f};
+        float3 up{0.0f, 1.0f, 0.0f};
+    };
+
+    struct SceneInstance
+    {
+        SceneMesh mesh;
+        MeshInstance instance;
+    };
+
+    void execute(const std::string& command, std::istream& args);
+
+    void renderFrame(const std::string& output);
+
+    Target& target(int width, int height, int samples);
+
+private:
+    ResourceCache& mCache;
+    VertexProcessor mCamera;
+    std::map<std::tuple<int, int, int>, Target> mTargets;
+    RenderQueue mQueue;
+    size_t mFrameCount = 0;
+    std::string mOutputPrefix;
+
+    // state of the file being executed
+    int mWidth = 400;
+    int mHeight = 400;
+    Camera mCameraSettings;
+    bool mDepthPrepass = false;
+    bool mOcclusionCulling = false;
+    size_t mGeometryThreads = 1;
+    int mSamples = 1;
+    ShadingRate mShadingRate = ShadingRate::Rate1x1;
+    std::map<std::string, std::shared_ptr<BMP>> mTextures;
+    std::map<std::string, SceneMesh> mMeshes;
+    std::map<std::string, std::shared_ptr<Light>> mLights;
+    std::vector<SceneInstance> mInstances;
+};
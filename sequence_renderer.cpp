@@ -0,0 +1,210 @@
+#include "sequence_renderer.hpp"
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <thread>
+#include "bounded_queue.hpp"
+#include "image_encoder.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <class F>
+void timed(double& ms, F&& f)
+{
+    const auto start = Clock::now();
+    f();
+    ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+}
+
+SequenceRenderer::SequenceRenderer(int width, int height, size_t queueDepth) : mWidth(width), mHeight(height), mQueueDepth(std::max<size_t>(queueDepth, 1)) {
+}
+
+void SequenceRenderer::submit(Mesh &mesh, const MeshInstance &instance) {
+    mDraws.push_back({&mesh, nullptr, instance});
+}
+
+void SequenceRenderer::submit(LodMesh &mesh, const MeshInstance &instance) {
+    mDraws.push_back({nullptr, &mesh, instance});
+}
+
+void SequenceRenderer::setCamera(const VertexProcessor &camera) {
+    mCamera = camera;
+}
+
+void SequenceRenderer::setDepthPrepass(bool enabled) {
+    mDepthPrepass = enabled;
+}
+
+void SequenceRenderer::setClearColor(const float3 &color) {
+    mClearColor = color;
+}
+
+SequenceStats SequenceRenderer::render(size_t frameCount, const Animation &animation, const std::string &outputPattern, bool pipelined) {
+    SequenceStats stats;
+    stats.frames = frameCount;
+    const auto start = Clock::now();
+
+    // level selection only needs the size of the target
+    RenderTarget geometryTarget(mWidth, mHeight, ColorFormat::None);
+    VertexProcessor geometryCamera;
+    Rasterizer geometryRasterizer(geometryTarget, geometryCamera);
+    RenderQueue geometryQueue;
+    RenderQueue rasterQueue;
+    rasterQueue.setDepthPrepass(mDepthPrepass);
+
+    if (!pipelined)
+    {
+        Target target(mWidth, mHeight);
+        Frame frame;
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            frame.index = i;
+            timed(stats.geometryMs, [&] { prepareFrame(animation, geometryQueue, geometryRasterizer, frame); });
+            timed(stats.rasterMs, [&] { rasterizeFrame(frame, rasterQueue, target); });
+            timed(stats.writeMs, [&] { writeFrame(target, outputPattern); });
+        }
+    }
+    else
+    {
+        BoundedQueue<std::unique_ptr<Frame>> prepared(mQueueDepth);
+        BoundedQueue<std::unique_ptr<Target>> rasterized(mQueueDepth);
+        // one per queue slot and one in each adjacent stage, recycled so buffers keep their capacity
+        BoundedQueue<std::unique_ptr<Frame>> freeFrames(mQueueDepth + 2);
+        BoundedQueue<std::unique_ptr<Target>> freeTargets(mQueueDepth + 2);
+        for (size_t i = 0; i < mQueueDepth + 2; i++)
+        {
+            freeFrames.push(std::make_unique<Frame>());
+            freeTargets.push(std::make_unique<Target>(mWidth, mHeight));
+        }
+
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        auto fail = [&] {
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+            prepared.close();
+            rasterized.close();
+            freeFrames.close();
+            freeTargets.close();
+        };
+
+        std::thread geometry([&] {
+            try
+            {
+                std::unique_ptr<Frame> frame;
+                for (size_t i = 0; i < frameCount && freeFrames.pop(frame); i++)
+                {
+                    frame->index = i;
+                    timed(stats.geometryMs, [&] { prepareFrame(animation, geometryQueue, geometryRasterizer, *frame); });
+                    if (!prepared.push(std::move(frame)))
+                    {
+                        return;
+                    }
+                }
+                prepared.close();
+            }
+            catch (...)
+            {
+                fail();
+            }
+        });
+        std::thread writer([&] {
+            try
+            {
+                std::unique_ptr<Target> target;
+                while (rasterized.pop(target))
+                {
+                    timed(stats.writeMs, [&] { writeFrame(*target, outputPattern); });
+                    freeTargets.push(std::move(target));
+                }
+            }
+            catch (...)
+            {
+                fail();
+            }
+        });
+
+        try
+        {
+            std::unique_ptr<Frame> frame;
+            std::unique_ptr<Target> target;
+            while (prepared.pop(frame) && freeTargets.pop(target))
+            {
+                timed(stats.rasterMs, [&] { rasterizeFrame(*frame, rasterQueue, *target); });
+                freeFrames.push(std::move(frame));
+                if (!rasterized.push(std::move(target)))
+                {
+                    break;
+                }
+            }
+            rasterized.close();
+        }
+        catch (...)
+        {
+            fail();
+        }
+        geometry.join();
+        writer.join();
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    stats.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    stats.framesPerSecond = stats.ms > 0.0 ? frameCount * 1000.0 / stats.ms : 0.0;
+    return stats;
+}
+
+void SequenceRenderer::prepareFrame(const Animation &animation, RenderQueue &queue, const Rasterizer &rasterizer, Frame &frame) const {
+    VertexProcessor camera = mCamera;
+    std::vector<MeshInstance> instances;
+    instances.reserve(mDraws.size());
+    for (const auto& draw : mDraws)
+    {
+        instances.push_back(draw.instance);
+    }
+    if (animation)
+    {
+        animation(frame.index, camera, instances);
+    }
+    for (size_t i = 0; i < mDraws.size(); i++)
+    {
+        if (mDraws[i].lod)
+        {
+            queue.submit(*mDraws[i].lod, instances[i]);
+        }
+        else
+        {
+            queue.submit(*mDraws[i].mesh, instances[i]);
+        }
+    }
+    queue.prepare(frame.prepared, rasterizer, camera);
+}
+
+void SequenceRenderer::rasterizeFrame(const Frame &frame, RenderQueue &queue, Target &target) const {
+    target.frame = frame.index;
+    target.camera = frame.prepared.camera;
+    target.target.clearColor(mClearColor);
+    target.target.clearDepth();
+    queue.execute(frame.prepared, target.rasterizer);
+}
+
+void SequenceRenderer::writeFrame(const Target &target, const std::string &outputPattern) const {
+    if (outputPattern.empty())
+    {
+        return;
+    }
+    std::vector<char> name(outputPattern.size() + 32);
+    std::snprintf(name.data(), name.size(), outputPattern.c_str(), (int)target.frame);
+    writeImage(target.target, name.data());
+}
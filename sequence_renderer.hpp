@@ -0,0 +1,90 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "render_queue.hpp"
+#include "render_target.hpp"
+
+struct SequenceStats
+{
+    size_t frames = 0;
+    double ms = 0.0;
+    double framesPerSecond = 0.0;
+    double geometryMs = 0.0;                 // busy time of each stage
+    double rasterMs = 0.0;
+    double writeMs = 0.0;
+};
+
+/*
+ * renders an animation of a fixed set of draws, in pipelined mode the vertex stage of frame N+1,
+ * rasterization of frame N and encoding of frame N-1 run on three threads connected by bounded queues
+ */
+class SequenceRenderer {
+public:
+    /*
+     * sets the camera and the instances of a frame, both start as set up before render for every frame
+     */
+    using Animation = std::function<void(size_t frame, VertexProcessor& camera, std::vector<MeshInstance>& instances)>;
+
+    /*
+     * queueDepth frames may wait between two stages before the earlier stage blocks
+     */
+    SequenceRenderer(int width, int height, size_t queueDepth = 2);
+
+    void submit(Mesh& mesh, const MeshInstance& instance);
+
+    void submit(LodMesh& mesh, const MeshInstance& instance);
+
+    void setCamera(const VertexProcessor& camera);
+
+    void setDepthPrepass(bool enabled);
+
+    void setClearColor(const float3& color);
+
+    /*
+     * outputPattern is a printf pattern taking the frame number, an empty pattern skips writing
+     */
+    SequenceStats render(size_t frameCount, const Animation& animation, const std::string& outputPattern, bool pipelined);
+
+private:
+    struct Draw
+    {
+        Mesh* mesh;
+        LodMesh* lod;
+        MeshInstance instance;
+    };
+
+    // color target with its rasterizer, owned by one stage at a time
+    struct Target
+    {
+        Target(int width, int height) : target(width, height), rasterizer(target, camera) {
+        }
+
+        size_t frame = 0;
+        VertexProcessor camera;
+        RenderTarget target;
+        Rasterizer rasterizer;
+    };
+
+    struct Frame
+    {
+        size_t index;
+        PreparedFrame prepared;
+    };
+
+    void prepareFrame(const Animation& animation, RenderQueue& queue, const Rasterizer& rasterizer, Frame& frame) const;
+
+    void rasterizeFrame(const Frame& frame, RenderQueue& queue, Target& target) const;
+
+    void writeFrame(const Target& target, const std::string& outputPattern) const;
+
+private:
+    int mWidth;
+    int mHeight;
+    size_t mQueueDepth;
+    std::vector<Draw> mDraws;
+    VertexProcessor mCamera;
+    bool mDepthPrepass = false;
+    float3 mClearColor{0.0f, 0.0f, 0.0f};
+};
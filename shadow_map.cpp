@@ -0,0 +1,145 @@
+#include "shadow_map.hpp"
+#include <cmath>
+#include <limits>
+#include "mesh.hpp"
+#include "render_stats.hpp"
+
+namespace {
+
+void hashBytes(size_t& hash, const void* data, size_t size)
+{
+    // FNV-1a
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+void hashVector(size_t& hash, const float4& v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        const float value = v[i];
+        hashBytes(hash, &value, sizeof(value));
+    }
+}
+
+}
+
+ShadowMap::ShadowMap(int size, float bias) : mSize(size), mBias(bias), mDepth(size, size, ColorFormat::None), mRasterizer(mDepth, mLightProcessor) {
+}
+
+bool ShadowMap::update(const Light &light, const std::vector<ShadowCaster> &casters) {
+    RENDER_STATS_SCOPE("ShadowMap::update");
+    size_t key = 14695981039346656037ull;
+    const float3& lightPosition = light.getPosition();
+    hashVector(key, float4{lightPosition.x(), lightPosition.y(), lightPosition.z(), 0.0f});
+    for (const auto& caster : casters)
+    {
+        hashBytes(key, &caster.mesh, sizeof(caster.mesh));
+        for (int i = 0; i < 4; i++)
+        {
+            hashVector(key, caster.transform[i]);
+        }
+    }
+    if (mRendered && key == mKey)
+    {
+        return false;
+    }
+
+    // world space sphere around every caster
+    float3 minCorner{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float3 maxCorner = minCorner * -1.0f;
+    std::vector<float4> centers;
+    std::vector<float> radii;
+    for (const auto& caster : casters)
+    {
+        caster.mesh->prepare();
+        const auto& c = caster.mesh->getBoundingCenter();
+        float4 center{c.x(), c.y(), c.z(), 1.0f};
+        center *= caster.transform;
+        float scale = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            scale = std::max(scale, float3{caster.transform[i][0], caster.transform[i][1], caster.transform[i][2]}.length());
+        }
+        const float radius = caster.mesh->getBoundingRadius() * scale;
+        for (int i = 0; i < 3; i++)
+        {
+            minCorner[i] = std::min(minCorner[i], center[i] - radius);
+            maxCorner[i] = std::max(maxCorner[i], center[i] + radius);
+        }
+        centers.push_back(center);
+        radii.push_back(radius);
+    }
+    mDepth.clearDepth();
+    if (!casters.empty())
+    {
+        const float3 sceneCenter = (minCorner + maxCorner) * 0.5f;
+        float sceneRadius = 0.0f;
+        for (size_t i = 0; i < centers.size(); i++)
+        {
+            sceneRadius = std::max(sceneRadius, (float3{centers[i].x(), centers[i].y(), centers[i].z()} - sceneCenter).length() + radii[i]);
+        }
+        light.setupShadowProjection(mLightProcessor, sceneCenter, std::max(sceneRadius, 1.0e-3f));
+
+        for (const auto& caster : casters)
+        {
+            MeshInstance instance;
+            instance.transform = caster.transform;
+            caster.mesh->drawInstanceDepth(mRasterizer, mLightProcessor, instance);
+        }
+    }
+    mKey = key;
+    mRendered = true;
+    mRenderCount++;
+    return true;
+}
+
+void ShadowMap::bindCamera(const VertexProcessor &camera) {
+    // row vectors: canonical camera -> world -> canonical light, perspective divide at the end
+    const float4x4 cameraProjection = camera.getView2Proj() * camera.getWorld2View();
+    const float4x4 lightProjection = mLightProcessor.getView2Proj() * mLightProcessor.getWorld2View();
+    mCanonicalToLight = lightProjection * inverse(cameraProjection);
+}
+
+float ShadowMap::sample(int x, int y, float depth) const {
+    if (x < 0 || y < 0 || x >= mSize || y >= mSize)
+    {
+        return 1.0f;
+    }
+    return depth - mBias > mDepth.depth(x, y) ? 0.0f : 1.0f;
+}
+
+float ShadowMap::visibility(const float3 &canonicalPosition) const {
+    if (!mRendered)
+    {
+        return 1.0f;
+    }
+    float4 p{canonicalPosition.x(), canonicalPosition.y(), canonicalPosition.z(), 1.0f};
+    p *= mCanonicalToLight;
+    if (p.w() <= 0.0f)
+    {
+        return 1.0f;
+    }
+    p /= p.w();
+    if (p.z() > 1.0f)
+    {
+        return 1.0f;
+    }
+    // same pixel mapping as Rasterizer::toPixelX and toPixelY
+    const float x = (p.x() + 1) * mSize * 0.5f - 0.5f;
+    const float y = mSize - ((p.y() + 1) * mSize * 0.5f) - 0.5f;
+    const int x0 = (int)std::floor(x);
+    const int y0 = (int)std::floor(y);
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const float top = sample(x0, y0, p.z()) * (1 - fx) + sample(x0 + 1, y0, p.z()) * fx;
+    const float bottom = sample(x0, y0 + 1, p.z()) * (1 - fx) + sample(x0 + 1, y0 + 1, p.z()) * fx;
+    return top * (1 - fy) + bottom * fy;
+}
+
+size_t ShadowMap::getRenderCount() const {
+    return mRenderCount;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "rasterizer.hpp"
+#include "render_target.hpp"
+#include "vertex_processor.hpp"
+
+class Mesh;
+
+struct ShadowCaster
+{
+    Mesh* mesh;
+    float4x4 transform;
+};
+
+/*
+ * depth of the casters seen from a light, kept until the light or the casters change
+ */
+class ShadowMap {
+public:
+    explicit ShadowMap(int size, float bias = 0.02f);
+
+    /*
+     * renders the casters depth only from the light, returns false when the cached map is still valid
+     */
+    bool update(const Light& light, const std::vector<ShadowCaster>& casters);
+
+    /*
+     * prepares lookups of fragments in canonical space of the camera
+     */
+    void bindCamera(const VertexProcessor& camera);
+
+    /*
+     * 1 for a lit fragment, 0 for a shadowed one, filtered over 2x2 texels
+     */
+    float visibility(const float3& canonicalPosition) const;
+
+    size_t getRenderCount() const;
+
+private:
+    float sample(int x, int y, float depth) const;
+
+private:
+    int mSize;
+    float mBias;
+    VertexProcessor mLightProcessor;
+    RenderTarget mDepth;
+    Rasterizer mRasterizer;
+    float4x4 mCanonicalToLight;
+    size_t mKey = 0;
+    bool mRendered = false;
+    size_t mRenderCount = 0;
+};
@@ -33,3 +33,12 @@ Sphere::Sphere(int horiz, int vert, const Vertex &center, float radius) : Mesh(v
         }
     }
 }
+
+LodMesh Sphere::createLod(const Vertex &center, float radius) {
+    LodMesh lod;
+    lod.addLevel(std::make_shared<Sphere>(3, 8, center, radius), 0.0f);
+    lod.addLevel(std::make_shared<Sphere>(7, 16, center, radius), 16.0f);
+    lod.addLevel(std::make_shared<Sphere>(15, 32, center, radius), 40.0f);
+    lod.addLevel(std::make_shared<Sphere>(31, 64, center, radius), 100.0f);
+    return lod;
+}
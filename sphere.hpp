@@ -1,9 +1,15 @@
 #pragma once
 
 #include "mesh.hpp"
+#include "lod_mesh.hpp"
 
 class Sphere : public Mesh {
 public:
     Sphere(int horiz, int vert, const Vertex &center, float radius);
+
+    /*
+     * tessellation levels from 8 to 64 segments around
+     */
+    static LodMesh createLod(const Vertex &center, float radius);
 };
 
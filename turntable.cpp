@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include "BMP.h"
+#include "point_light.hpp"
+#include "sequence_renderer.hpp"
+#include "shadow_map.hpp"
+#include "sphere.hpp"
+
+namespace {
+
+void report(const char* mode, const SequenceStats& stats)
+{
+    std::cout << mode << ": " << stats.frames << " frames in " << stats.ms << " ms, " << stats.framesPerSecond << " frames/s (busy ms: geometry "
+              << stats.geometryMs << ", raster " << stats.rasterMs << ", write " << stats.writeMs << ")" << std::endl;
+}
+
+}
+
+/*
+ * usage: turntable [--frames N] [--queue-depth N] [--output PATTERN|--no-output]
+ * renders the scene of main.cpp spinning once around its center, first one frame after another, then pipelined,
+ * run from a directory holding moon.bmp and earth.bmp
+ */
+int main(int argc, char** argv) {
+    size_t frames = 120;
+    size_t queueDepth = 2;
+    std::string output = "turntable_%03d.bmp";
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (arg == "--queue-depth" && i + 1 < argc)
+        {
+            queueDepth = std::max(std::stoi(argv[++i]), 1);
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (arg == "--no-output")
+        {
+            output.clear();
+        }
+        else
+        {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    // far enough back that the outer spheres stay in front of the near plane while they swing around
+    const float3 center{0.0f, 0.0f, -1.25f};
+    VertexProcessor camera;
+    camera.setPerspective(90, 1, 0.5, 100);
+    camera.setLookAt(float3{0.0f, 0.5f, 1.5f}, center, float3{0.0f, 1.0f, 0.0f});
+    PointLight light(float3{0, 1, 0}, float3{0.1, 0.1, 0.1}, float3{0.4, 0.4, 0.4}, float3{0.5, 0.5, 0.5}, 12.f);
+    light.setShadowMap(std::make_shared<ShadowMap>(512));
+    VertexProcessor textureProcessor;
+    const auto moon = std::make_shared<BMP>("moon.bmp", textureProcessor);
+    const auto earth = std::make_shared<BMP>("earth.bmp", textureProcessor);
+    Vertex sphereCenter;
+    LodMesh sphere = Sphere::createLod(sphereCenter, .5f);
+
+    SequenceRenderer renderer(400, 400, queueDepth);
+    renderer.setCamera(camera);
+    renderer.setDepthPrepass(true);
+    const float3 offsets[] = {{0.0f, 0.0f, -1.5f}, {-1.0f, 0.0f, -1.0f}, {1.0f, 0.0f, -1.0f}};
+    for (int i = 0; i < 3; i++)
+    {
+        MeshInstance instance;
+        instance.transform = VertexProcessor::translation(offsets[i]);
+        instance.texture = i == 0 ? moon : earth;
+        instance.light = &light;
+        renderer.submit(sphere, instance);
+    }
+
+    const auto spin = [&](size_t frame, VertexProcessor&, std::vector<MeshInstance>& instances) {
+        const float4x4 turn = VertexProcessor::translation(center) * VertexProcessor::rotation(360.0f * frame / frames, float3{0.0f, 1.0f, 0.0f})
+                              * VertexProcessor::translation(float3{0.0f, 0.0f, 0.0f} - center);
+        for (auto& instance : instances)
+        {
+            instance.transform = turn * instance.transform;
+        }
+    };
+
+    const auto sequential = renderer.render(frames, spin, output, false);
+    report("sequential", sequential);
+    const auto pipelined = renderer.render(frames, spin, output, true);
+    report("pipelined", pipelined);
+    std::cout << "speedup " << pipelined.framesPerSecond / sequential.framesPerSecond << "x" << std::endl;
+    return 0;
+}
@@ -5,3 +5,38 @@ float3 crossProduct(const float3& firstVector, const float3& secondVector)
 return {firstVector.y() * secondVector.z() - firstVector.z() * secondVector.y(), firstVector.z() * secondVector.x() - firstVector.x() * secondVector.z(), firstVector.x() * secondVector.y() - firstVector.y() * secondVector.x()};
 }
 
+float4x4 inverse(const float4x4& matrix)
+{
+    float4x4 a = matrix;
+    float4x4 result{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+    for (int column = 0; column < 4; column++)
+    {
+        int pivot = column;
+        for (int row = column + 1; row < 4; row++)
+        {
+            if (std::fabs(a[row][column]) > std::fabs(a[pivot][column]))
+            {
+                pivot = row;
+            }
+        }
+        if (std::fabs(a[pivot][column]) < 1.0e-12f)
+        {
+            throw std::runtime_error("singular matrix");
+        }
+        std::swap(a[column], a[pivot]);
+        std::swap(result[column], result[pivot]);
+        const float scale = 1.0f / a[column][column];
+        a[column] *= scale;
+        result[column] *= scale;
+        for (int row = 0; row < 4; row++)
+        {
+            if (row != column)
+            {
+                const float factor = a[row][column];
+                a[row] -= a[column] * factor;
+                result[row] -= result[column] * factor;
+            }
+        }
+    }
+    return result;
+}
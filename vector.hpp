@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <vector>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <stdexcept>
@@ -8,17 +10,23 @@
 template <class T, int SIZE>
 class Vector {
 public:
-    Vector(std::initializer_list<T> il) : mData(std::move(il))
+    Vector(std::initializer_list<T> il) : mData{}
     {
-        assert(SIZE == mData.size());
+        assert(SIZE == il.size());
+        std::copy_n(il.begin(), std::min<size_t>(il.size(), SIZE), mData.begin());
     }
 
-    Vector(std::vector<T> data) : mData(std::move(data))
+    Vector(const std::vector<T>& data) : mData{}
     {
-        assert(SIZE == mData.size());
+        assert(SIZE == data.size());
+        std::copy_n(data.begin(), std::min<size_t>(data.size(), SIZE), mData.begin());
     }
 
-    Vector() : mData(SIZE)
+    Vector(const std::array<T, SIZE>& data) : mData(data)
+    {
+    }
+
+    Vector() : mData{}
     {
     }
 
@@ -144,6 +152,22 @@ public:
         }
     }
 
+    /*
+     * normalize for the per vertex and per pixel paths, vectors shorter than the epsilon become zero
+     * instead of throwing, degenerate triangles leave such normals
+     */
+    void normalizeUnchecked()
+    {
+        constexpr float epsilon = 1.0e-4;
+        const auto len = length();
+        // dividing by infinity zeroes a degenerate vector, the select compiles without a branch
+        const auto divisor = len > epsilon ? len : INFINITY;
+        for (auto& item : mData)
+        {
+            item /= divisor;
+        }
+    }
+
     Vector<T, SIZE>& operator=(const Vector<T, SIZE>& other) = default;
 
     Vector<T, SIZE>& operator*=(T scalar)
@@ -249,6 +273,14 @@ public:
         return *this*((T)(1)/scalar);
     }
 
+    /*
+     * operator/ without the zero check, a zero divisor gives infinities as in IEEE arithmetic
+     */
+    Vector<T, SIZE> divideUnchecked(T scalar) const
+    {
+        return *this*((T)(1)/scalar);
+    }
+
     Vector<T, SIZE> operator+(const Vector<T, SIZE>& other) const
     {
         auto dataCopy = mData;
@@ -361,7 +393,8 @@ public:
     }
 
 private:
-    std::vector<T> mData;
+    // inline storage, vectors are value types created by the million in the pipeline
+    std::array<T, SIZE> mData;
 };
 
 using float3 = Vector<float, 3>;
@@ -369,4 +402,9 @@ using float4 = Vector<float, 4>;
 using int3 = Vector<int, 3>;
 using float4x4 = Vector<Vector<float, 4>, 4>;
 
-float3 crossProduct(const float3& firstVector, const float3& secondVector);
\ No newline at end of file
+float3 crossProduct(const float3& firstVector, const float3& secondVector);
+
+/*
+ * inverse of a row-major matrix, throws when the matrix is singular
+ */
+float4x4 inverse(const float4x4& matrix);
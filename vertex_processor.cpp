@@ -1,6 +1,8 @@
 #include "vertex_processor.hpp"
 #include "vector.hpp"
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
 void VertexProcessor::setPerspective(float fovy, float aspect, float near, float far) {
     fovy *= M_PI / 360; // FOVy/2
@@ -9,14 +11,40 @@ void VertexProcessor::setPerspective(float fovy, float aspect, float near, float
     mView2Proj[ 1 ] = float4 {0 , f , 0 , 0 } ;
     mView2Proj[ 2 ] = float4 { 0 , 0 , ( far+near ) / ( near-far ) , -1} ;
     mView2Proj[ 3 ] = float4 { 0 , 0 , 2*far* near / ( near-far ) , 0 };
+    mHasPerspective = true;
+    mOrthographic = false;
+    mTanHalfFovy = std::tan( fovy );
+    mAspect = aspect;
+    mNear = near;
+    mFar = far;
+}
+
+void VertexProcessor::setOrthographic(float halfWidth, float halfHeight, float near, float far) {
+    mView2Proj[ 0 ] = float4 { 1 / halfWidth , 0 , 0 , 0 } ;
+    mView2Proj[ 1 ] = float4 { 0 , 1 / halfHeight , 0 , 0 } ;
+    mView2Proj[ 2 ] = float4 { 0 , 0 , 2 / ( near-far ) , 0 } ;
+    mView2Proj[ 3 ] = float4 { 0 , 0 , ( far+near ) / ( near-far ) , 1 };
+    mHasPerspective = true;
+    mOrthographic = true;
+    mHalfWidth = halfWidth;
+    mHalfHeight = halfHeight;
+    mAspect = halfWidth / halfHeight;
+    mNear = near;
+    mFar = far;
 }
 
 float3 VertexProcessor::convertToCanonical(const float3 &worldCoords) const {
+    float inverseW = 0.0f;
+    return convertToCanonical(worldCoords, inverseW);
+}
+
+float3 VertexProcessor::convertToCanonical(const float3 &worldCoords, float &inverseW) const {
     float4 coords({worldCoords.x(), worldCoords.y(), worldCoords.z(), 1.0f});
     coords *= mObj2World;
     coords *= mWorld2View;
     coords *= mView2Proj;
-    coords /= coords.w();
+    inverseW = 1.0f / coords.w();
+    coords = coords.divideUnchecked(coords.w());
     return {coords.x(), coords.y(), coords.z()};
 }
 
@@ -25,6 +53,7 @@ void VertexProcessor::setLookAt(float3 eye, float3 center, float3 up) {
     f.normalize();
     up.normalize();
     float3 s = crossProduct(f ,up);
+    s.normalize();
     float3 u = crossProduct(s,f);
     mWorld2View [ 0 ] = float4 { s [ 0 ] , u [ 0 ] , -f [ 0 ] , 0 } ;
     mWorld2View [ 1 ] = float4 { s [ 1 ] , u [ 1 ] , -f [ 1 ] , 0 } ;
@@ -40,25 +69,53 @@ void VertexProcessor::setLookAt(float3 eye, float3 center, float3 up) {
 }
 
 void VertexProcessor::multByTranslation(float3 v) {
+    mObj2World = translation(v) * mObj2World;
+}
+
+void VertexProcessor::multByScale( float3 v )
+{
+    mObj2World = scale(v) * mObj2World;
+}
+
+void VertexProcessor::multByRotation(float a, float3 v) {
+    mObj2World = rotation(a, v) * mObj2World;
+}
+
+void VertexProcessor::setObj2World(const float4x4 &obj2World) {
+    mObj2World = obj2World;
+}
+
+const float4x4 &VertexProcessor::getObj2World() const {
+    return mObj2World;
+}
+
+const float4x4 &VertexProcessor::getWorld2View() const {
+    return mWorld2View;
+}
+
+const float4x4 &VertexProcessor::getView2Proj() const {
+    return mView2Proj;
+}
+
+float4x4 VertexProcessor::translation(float3 v) {
     float4x4 m;
     m[0] = float4 {1 , 0 , 0 , 0 };
     m[1] = float4 { 0 , 1 , 0 , 0 };
     m[2] = float4 { 0 , 0 , 1 , 0 };
     m[3] = float4{v.x() , v.y() , v.z() , 1};
-    mObj2World = m * mObj2World;
+    return m;
 }
 
-void VertexProcessor::multByScale( float3 v )
-{
+float4x4 VertexProcessor::scale(float3 v) {
     float4x4 m;
     m[0] = float4 {v.x() , 0 , 0 , 0 };
     m[1] = float4 { 0 , v.y() , 0 , 0 };
     m[2] = float4 { 0 , 0 , v.z() , 0 };
     m[3] = float4{0, 0, 0 , 1};
-    mObj2World = m * mObj2World;
+    return m;
 }
 
-void VertexProcessor::multByRotation(float a, float3 v) {
+float4x4 VertexProcessor::rotation(float a, float3 v) {
     float s=sinf( a * M_PIf32 / 180 );
     float c=cosf( a * M_PIf32 / 180 ) ;
     v.normalize();
@@ -73,7 +130,105 @@ void VertexProcessor::multByRotation(float a, float3 v) {
     v.z() * v.z() * (1 - c )+c , 0 };
 
     m[3] = float4{0, 0, 0 , 1};
-    mObj2World = m * mObj2World;
+    return m;
+}
+
+float3 VertexProcessor::convertToView(const float3 &objCoords) const {
+    float4 coords({objCoords.x(), objCoords.y(), objCoords.z(), 1.0f});
+    coords *= mObj2World;
+    coords *= mWorld2View;
+    return {coords.x(), coords.y(), coords.z()};
+}
+
+float3 VertexProcessor::convertDirectionToView(const float3 &objDirection) const {
+    float4 coords({objDirection.x(), objDirection.y(), objDirection.z(), 0.0f});
+    coords *= mObj2World;
+    coords *= mWorld2View;
+    return {coords.x(), coords.y(), coords.z()};
+}
+
+float VertexProcessor::maxScale() const {
+    float result = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        const float3 axis{mObj2World[i][0], mObj2World[i][1], mObj2World[i][2]};
+        result = std::max(result, axis.length());
+    }
+    return result;
 }
 
+bool VertexProcessor::isSphereVisible(const float3 &center, float radius) const {
+    if (!mHasPerspective)
+    {
+        return true;
+    }
+    const float3 c = convertToView(center);
+    const float r = radius * maxScale();
+    // camera looks along -z
+    if (-c.z() + r < mNear || -c.z() - r > mFar)
+    {
+        return false;
+    }
+    if (mOrthographic)
+    {
+        return std::fabs(c.x()) - r < mHalfWidth && std::fabs(c.y()) - r < mHalfHeight;
+    }
+    const float ty = mTanHalfFovy;
+    const float tx = mTanHalfFovy * mAspect;
+    const float ny = 1.0f / sqrtf(1.0f + ty * ty);
+    const float nx = 1.0f / sqrtf(1.0f + tx * tx);
+    return ( c.y() + ty * c.z()) * ny < r &&
+           (-c.y() + ty * c.z()) * ny < r &&
+           ( c.x() + tx * c.z()) * nx < r &&
+           (-c.x() + tx * c.z()) * nx < r;
+}
 
+float VertexProcessor::projectedRadius(const float3 &center, float radius) const {
+    if (!mHasPerspective)
+    {
+        return radius * maxScale();
+    }
+    const float3 c = convertToView(center);
+    const float r = radius * maxScale();
+    if (mOrthographic)
+    {
+        return r / mHalfHeight;
+    }
+    const float distance = -c.z();
+    if (distance <= r || distance <= mNear)
+    {
+        return std::numeric_limits<float>::max();
+    }
+    return r / (distance * mTanHalfFovy);
+}
+
+bool VertexProcessor::projectSphere(const float3 &center, float radius, ScreenBounds &bounds) const {
+    if (!mHasPerspective)
+    {
+        return false;
+    }
+    const float3 c = convertToView(center);
+    const float r = radius * maxScale();
+    if (-c.z() - r <= mNear)
+    {
+        return false;
+    }
+    auto project = [this](float x, float y, float z) {
+        float4 coords({x, y, z, 1.0f});
+        coords *= mView2Proj;
+        coords /= coords.w();
+        return float3{coords.x(), coords.y(), coords.z()};
+    };
+    bounds.minX = bounds.minY = std::numeric_limits<float>::max();
+    bounds.maxX = bounds.maxY = -std::numeric_limits<float>::max();
+    for (int corner = 0; corner < 8; corner++)
+    {
+        const float3 p = project(c.x() + (corner & 1 ? r : -r), c.y() + (corner & 2 ? r : -r), c.z() + (corner & 4 ? r : -r));
+        bounds.minX = std::min(bounds.minX, p.x());
+        bounds.maxX = std::max(bounds.maxX, p.x());
+        bounds.minY = std::min(bounds.minY, p.y());
+        bounds.maxY = std::max(bounds.maxY, p.y());
+    }
+    bounds.minDepth = project(c.x(), c.y(), c.z() + r).z();
+    return true;
+}
@@ -2,10 +2,27 @@
 
 #include "vector.hpp"
 
+/*
+ * screen rectangle and nearest depth in canonical space
+ */
+struct ScreenBounds
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    float minDepth;
+};
+
 class VertexProcessor {
 public:
     void setPerspective(float fovy, float aspect, float near, float far);
 
+    /*
+     * projection of a box of halfWidth x halfHeight between near and far
+     */
+    void setOrthographic(float halfWidth, float halfHeight, float near, float far);
+
     void setLookAt(float3 eye , float3 center , float3 up);
 
     void multByTranslation(float3 v);
@@ -14,11 +31,61 @@ public:
 
     void multByRotation( float a , float3 v );
 
+    void setObj2World(const float4x4& obj2World);
+
+    const float4x4& getObj2World() const;
+
+    const float4x4& getWorld2View() const;
+
+    const float4x4& getView2Proj() const;
+
     float3 convertToCanonical(const float3& worldCoords) const;
 
+    /*
+     * also returns 1 / w of the clip coordinates, what perspective correct interpolation needs
+     */
+    float3 convertToCanonical(const float3& worldCoords, float& inverseW) const;
+
+    /*
+     * frustum test of an object space bounding sphere, uses current object, view and projection matrices
+     */
+    bool isSphereVisible(const float3& center, float radius) const;
+
+    /*
+     * approximate radius of an object space sphere after projection, in canonical units of the y axis
+     */
+    float projectedRadius(const float3& center, float radius) const;
+
+    /*
+     * conservative screen bounds of an object space sphere, false when the sphere reaches the near plane
+     */
+    bool projectSphere(const float3& center, float radius, ScreenBounds& bounds) const;
+
+    float3 convertToView(const float3& objCoords) const;
+
+    float3 convertDirectionToView(const float3& objDirection) const;
+
+    /*
+     * largest axis scale of the object to world matrix
+     */
+    float maxScale() const;
+
+    static float4x4 translation(float3 v);
+
+    static float4x4 scale(float3 v);
+
+    static float4x4 rotation(float a, float3 v);
+
 private:
     float4x4 mView2Proj;
     float4x4 mWorld2View{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
     float4x4 mObj2World{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+    bool mHasPerspective = false;
+    bool mOrthographic = false;
+    float mHalfWidth = 1.0f;
+    float mHalfHeight = 1.0f;
+    float mTanHalfFovy = 1.0f;
+    float mAspect = 1.0f;
+    float mNear = 0.0f;
+    float mFar = 0.0f;
 };
-